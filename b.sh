@@ -1,7 +1,11 @@
 #!/bin/sh
 
-gcc -o ./server/s ./server/server.c ./hash_table/hash_table.c ./hash_table/prime.c ./client_queue/client_queue.c -lm
+# Vocabularies of the rooms, compiled into the server
+gcc -o ./vocab_compiler/vc ./vocab_compiler/vocab_compiler.c ./phash/phash.c ./phrase/phrase.c ./tokenizer/tokenizer.c ./hash_table/hash_table.c ./hash_table/hash_table_swiss.c ./bloom/bloom.c
+./vocab_compiler/vc ./server/vocab_compiled.c ./server/vocab.txt
 
-gcc -o ./client/c ./client/client.c ./auth/user_auth.c
+gcc $CFLAGS -o ./server/s ./server/server.c ./cache/cache.c ./protocol/protocol.c ./hash_table/hash_table.c ./hash_table/hash_table_swiss.c ./bloom/bloom.c ./hash_table/hash_table_concurrent.c ./phash/phash.c ./phrase/phrase.c ./server/vocab_compiled.c ./reactor/reactor.c ./reactor/reactor_uring.c ./tokenizer/tokenizer.c ./worker_pool/worker_pool.c ./rcu/rcu.c -lm -lpthread
+
+gcc -o ./client/c ./client/client.c ./protocol/protocol.c ./auth/user_auth.c
 
 ./server/s
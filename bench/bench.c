@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../hash_table/hash_table.h"
+#include "bench.h"
+
+#define BENCH_MAX_LINE 1024
+
+double bench_now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void bench_words_add(bench_words *w, int *capacity, const char *key,
+                            const char *value) {
+  if (w->count == *capacity) {
+    *capacity = *capacity > 0 ? *capacity * 2 : 1024;
+    w->keys = realloc(w->keys, *capacity * sizeof(char *));
+    w->values = realloc(w->values, *capacity * sizeof(char *));
+    if (w->keys == NULL || w->values == NULL) {
+      perror("Failed to allocate words");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  char *k = malloc(strlen(key) + 1);
+  char *v = strdup(value);
+  if (k == NULL || v == NULL) {
+    perror("Failed to allocate words");
+    exit(EXIT_FAILURE);
+  }
+  ht_fold_key(k, key);
+  w->keys[w->count] = k;
+  w->values[w->count] = v;
+  w->count++;
+}
+
+void bench_words_load(bench_words *w, const char *path) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    perror(path);
+    exit(EXIT_FAILURE);
+  }
+
+  memset(w, 0, sizeof(*w));
+  int capacity = 0;
+  char line[BENCH_MAX_LINE], *saveptr;
+  while (fgets(line, sizeof(line), file) != NULL) {
+    line[strcspn(line, "\n")] = 0;
+    char *first_word = strtok_r(line, ",", &saveptr);
+    char *second_word = first_word != NULL ? strtok_r(NULL, ",", &saveptr)
+                                           : NULL;
+    if (second_word != NULL) {
+      bench_words_add(w, &capacity, first_word, second_word);
+    }
+  }
+  fclose(file);
+}
+
+// Random letters, then the index in 5 letters: words of the same length
+// differ in those, so no two are the same
+void bench_words_synthetic(bench_words *w, int count) {
+  memset(w, 0, sizeof(*w));
+  int capacity = 0;
+  unsigned seed = 1;
+  char word[16];
+  for (int i = 0; i < count; i++) {
+    int len = 1 + rand_r(&seed) % 7;
+    for (int c = 0; c < len; c++) {
+      word[c] = 'a' + rand_r(&seed) % 26;
+    }
+    for (int c = 0, n = i; c < 5; c++, n /= 26) {
+      word[len++] = 'a' + n % 26;
+    }
+    word[len] = '\0';
+    bench_words_add(w, &capacity, word, "translation");
+  }
+}
+
+void bench_words_free(bench_words *w) {
+  for (int i = 0; i < w->count; i++) {
+    free(w->keys[i]);
+    free(w->values[i]);
+  }
+  free(w->keys);
+  free(w->values);
+  memset(w, 0, sizeof(*w));
+}
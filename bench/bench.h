@@ -0,0 +1,30 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// What the dictionary benchmarks share: a clock, and the words they fill
+// their tables with, read from a vocabulary file or made up. Keys are folded
+// like the server folds them (hash_table.h), so they can be searched in any
+// case.
+
+#define BENCH_VOCABULARY "./server/vocab.txt"
+
+typedef struct {
+  char **keys;
+  char **values;
+  int count;
+} bench_words;
+
+// Seconds, CLOCK_MONOTONIC
+double bench_now();
+
+// The source words of a vocabulary file ("source,target" lines) and their
+// translations. Exits when the file can't be read.
+void bench_words_load(bench_words *w, const char *path);
+
+// count distinct words of 6 to 12 letters, at most BENCH_MAX_SYNTHETIC
+#define BENCH_MAX_SYNTHETIC (26 * 26 * 26 * 26 * 26)
+void bench_words_synthetic(bench_words *w, int count);
+
+void bench_words_free(bench_words *w);
+
+#endif // BENCH_H
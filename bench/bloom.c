@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../bloom/bloom.h"
+#include "../hash_table/hash_table.h"
+#include "../hash_table/hash_table_internal.h"
+#include "bench.h"
+
+// Searches of a vocabulary table with and without its Bloom filter
+// (ht_filter_build), on words it mostly doesn't have: a chat message is
+// names, numbers and slang more than vocabulary. Words are searched folding
+// like the server does, on a text vocabulary loaded like the server loads
+// it, then on a large synthetic one. The false positives measured on words
+// never added are printed next to the rate the filter computes.
+//
+//   ./bench/bloom [vocabulary] [synthetic words]
+
+#define BENCH_SEARCHES 4000000
+#define BENCH_QUERIES 65536 // distinct words searched, a power of 2
+#define BENCH_HITS 10       // % of them in the vocabulary
+#define BENCH_MISSES 2000000
+#define BENCH_SYNTHETIC 1000000
+#define BENCH_WORD_SIZE 32
+
+static const char *chat_words[] = {"marco", "lol", "giulia", "xd", "ahah",
+                                   "ok", "2024", "brb"};
+
+// Nanoseconds per search, *found counts the ones that found a value
+static double search_ns(ht_hash_table *ht, char (*queries)[BENCH_WORD_SIZE],
+                        const size_t *lens, long *found) {
+  *found = 0;
+  const double start = bench_now();
+  for (int i = 0; i < BENCH_SEARCHES; i++) {
+    const int q = i & (BENCH_QUERIES - 1);
+    *found += ht_search_fold(ht, queries[q], lens[q]) != NULL;
+  }
+  return (bench_now() - start) * 1e9 / BENCH_SEARCHES;
+}
+
+static void bench_run(const char *name, const bench_words *w) {
+  ht_hash_table *ht = ht_new();
+  if (ht == NULL) {
+    perror("Failed to allocate table");
+    exit(EXIT_FAILURE);
+  }
+  for (int i = 0; i < w->count; i++) {
+    if (ht_insert(ht, w->keys[i], w->values[i]) < 0) {
+      perror("Failed to insert");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  // Vocabulary words capitalized like the first of a sentence, the others
+  // made unique with a number like usernames and counts are
+  static char queries[BENCH_QUERIES][BENCH_WORD_SIZE];
+  static size_t lens[BENCH_QUERIES];
+  unsigned seed = 1;
+  for (int q = 0; q < BENCH_QUERIES; q++) {
+    if (rand_r(&seed) % 100 < BENCH_HITS) {
+      const char *key = w->keys[rand_r(&seed) % w->count];
+      lens[q] = snprintf(queries[q], BENCH_WORD_SIZE, "%s", key);
+      queries[q][0] = queries[q][0] >= 'a' && queries[q][0] <= 'z'
+                          ? queries[q][0] - ('a' - 'A')
+                          : queries[q][0];
+    } else {
+      const int n = sizeof(chat_words) / sizeof(chat_words[0]);
+      lens[q] = snprintf(queries[q], BENCH_WORD_SIZE, "%s%d",
+                         chat_words[rand_r(&seed) % n], rand_r(&seed));
+    }
+  }
+
+  printf("%s, %d words, %d%% of the words searched in it\n", name,
+         w->count, BENCH_HITS);
+  long found;
+  const double without = search_ns(ht, queries, lens, &found);
+  printf("  no filter: %.1f ns/search, found %ld\n", without, found);
+
+  if (ht_filter_build(ht) < 0) {
+    perror("Failed to allocate filter");
+    exit(EXIT_FAILURE);
+  }
+  const double with = search_ns(ht, queries, lens, &found);
+  printf("  filter:    %.1f ns/search (%.2fx), found %ld\n", with,
+         without / with, found);
+
+  long false_positives = 0;
+  char word[BENCH_WORD_SIZE];
+  for (long i = 0; i < BENCH_MISSES; i++) {
+    const int len = snprintf(word, sizeof(word), "miss%ld", i);
+    false_positives += !ht_filtered_out(ht, ht_hash_fold(word, len));
+  }
+  printf("  false positives %.3f%% measured, %.3f%% computed, %zu bytes "
+         "of filter\n",
+         100.0 * false_positives / BENCH_MISSES,
+         100 * bloom_false_positive_rate(ht->filter),
+         bloom_size(ht->filter));
+
+  ht_del_hash_table(ht);
+}
+
+int main(int argc, char *argv[]) {
+  const char *path = argc > 1 ? argv[1] : BENCH_VOCABULARY;
+  const int synthetic = argc > 2 ? atoi(argv[2]) : BENCH_SYNTHETIC;
+  if (synthetic <= 0 || synthetic > BENCH_MAX_SYNTHETIC) {
+    fprintf(stderr, "Usage: %s [vocabulary] [synthetic words]\n", argv[0]);
+    return 1;
+  }
+
+  bench_words w;
+  bench_words_load(&w, path);
+  bench_run(path, &w);
+  bench_words_free(&w);
+
+  bench_words_synthetic(&w, synthetic);
+  bench_run("synthetic", &w);
+  bench_words_free(&w);
+  return 0;
+}
@@ -0,0 +1,268 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../hash_table/hash_table.h"
+#include "../hash_table/hash_table_concurrent.h"
+#include "../rcu/rcu.h"
+#include "bench.h"
+
+// The concurrent table (hash_table_concurrent.h) against a plain table
+// behind a reader-writer lock, searched the way the server searches the
+// corrections of a vocabulary: folded words, one read section per message.
+//
+// First one thread searching a word the table doesn't have, on an empty
+// table (what every word costs when nobody sent a correction: cht_empty
+// returns before hashing) and on tables holding other keys (what it costs
+// otherwise). Then readers searching during writes, on a table nobody writes
+// to that stays empty, and on a populated one with a writer changing and
+// deleting keys all the time.
+//
+//   ./bench/concurrent_table [max readers] [seconds per run]
+
+#define BENCH_SEARCHES 20000000
+#define BENCH_KEYS 100000
+#define BENCH_KEY_SIZE 16
+#define BENCH_MESSAGE_WORDS 16 // searches per read section
+#define BENCH_READERS 4
+#define BENCH_SECONDS 1.0
+
+typedef enum { BENCH_CONCURRENT, BENCH_RWLOCK } bench_kind;
+
+typedef struct {
+  bench_kind kind;
+  cht_hash_table *cht;
+  ht_hash_table *ht;
+  pthread_rwlock_t lock;
+
+  atomic_int stopping;
+  atomic_long reads;
+  atomic_long writes;
+  atomic_long wrong; // values that aren't the key's
+} bench;
+
+// Keys are "k<number>", made once: readers only pick one
+static char keys[BENCH_KEYS][BENCH_KEY_SIZE];
+static size_t key_lens[BENCH_KEYS];
+
+// Values are "v<key number>-<version>"
+
+static void value_of(char *value, size_t size, int n, int version) {
+  snprintf(value, size, "v%d-%d", n, version);
+}
+
+static int value_matches(const char *value, int n) {
+  return value[0] == 'v' && atoi(value + 1) == n;
+}
+
+static void bench_insert(bench *b, const char *key, const char *value) {
+  if (b->kind == BENCH_CONCURRENT) {
+    cht_insert(b->cht, key, value);
+  } else {
+    pthread_rwlock_wrlock(&b->lock);
+    if (ht_insert(b->ht, key, value) < 0) {
+      perror("Failed to insert");
+      exit(EXIT_FAILURE);
+    }
+    pthread_rwlock_unlock(&b->lock);
+  }
+}
+
+static void bench_delete(bench *b, const char *key) {
+  if (b->kind == BENCH_CONCURRENT) {
+    cht_delete(b->cht, key);
+  } else {
+    pthread_rwlock_wrlock(&b->lock);
+    ht_delete(b->ht, key);
+    pthread_rwlock_unlock(&b->lock);
+  }
+}
+
+// Empty table
+//
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+// Nanoseconds per folding search of a word the table doesn't have, in case
+// it's not folded yet: like a word of a message
+static double search_ns(cht_hash_table *t) {
+  const char word[] = "Translation";
+  volatile long found = 0;
+
+  const double start = bench_now();
+  rcu_read_lock();
+  for (int i = 0; i < BENCH_SEARCHES; i++) {
+    found += cht_search_fold(t, word, sizeof(word) - 1) != NULL;
+  }
+  rcu_read_unlock();
+  return (bench_now() - start) * 1e9 / BENCH_SEARCHES;
+}
+
+static void bench_empty() {
+  cht_hash_table *t = cht_new();
+  if (t == NULL) {
+    perror("Failed to allocate table");
+    exit(EXIT_FAILURE);
+  }
+
+  printf("one thread, a word the table doesn't have:\n");
+  printf("  empty: %.1f ns/search\n", search_ns(t));
+
+  const int sizes[] = {1, BENCH_KEYS};
+  char value[32];
+  int count = 0;
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    for (; count < sizes[i]; count++) {
+      value_of(value, sizeof(value), count, 0);
+      cht_insert(t, keys[count], value);
+    }
+    printf("  %d keys: %.1f ns/search\n", count, search_ns(t));
+  }
+  cht_del_hash_table(t);
+}
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+// Readers during writes
+//
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+static void *reader_thread(void *arg) {
+  bench *b = arg;
+  unsigned seed = (unsigned)(long)pthread_self();
+  int numbers[BENCH_MESSAGE_WORDS];
+  long reads = 0, wrong = 0;
+
+  while (!atomic_load_explicit(&b->stopping, memory_order_relaxed)) {
+    for (int i = 0; i < BENCH_MESSAGE_WORDS; i++) {
+      numbers[i] = rand_r(&seed) % BENCH_KEYS;
+    }
+
+    if (b->kind == BENCH_CONCURRENT) {
+      rcu_read_lock();
+      for (int i = 0; i < BENCH_MESSAGE_WORDS; i++) {
+        const int n = numbers[i];
+        const char *v = cht_search_fold(b->cht, keys[n], key_lens[n]);
+        wrong += v != NULL && !value_matches(v, n);
+      }
+      rcu_read_unlock();
+    } else {
+      pthread_rwlock_rdlock(&b->lock);
+      for (int i = 0; i < BENCH_MESSAGE_WORDS; i++) {
+        const int n = numbers[i];
+        const char *v = ht_search_fold(b->ht, keys[n], key_lens[n]);
+        wrong += v != NULL && !value_matches(v, n);
+      }
+      pthread_rwlock_unlock(&b->lock);
+    }
+    reads += BENCH_MESSAGE_WORDS;
+  }
+
+  atomic_fetch_add(&b->reads, reads);
+  atomic_fetch_add(&b->wrong, wrong);
+  return NULL;
+}
+
+// A moderator who never stops: new values for random keys, one in 8 deleted
+static void *writer_thread(void *arg) {
+  bench *b = arg;
+  unsigned seed = 1;
+  char value[32];
+  long writes = 0;
+
+  while (!atomic_load_explicit(&b->stopping, memory_order_relaxed)) {
+    const int n = rand_r(&seed) % BENCH_KEYS;
+    if (rand_r(&seed) % 8 == 0) {
+      bench_delete(b, keys[n]);
+    } else {
+      value_of(value, sizeof(value), n, rand_r(&seed) % 100);
+      bench_insert(b, keys[n], value);
+    }
+    writes++;
+  }
+
+  atomic_store(&b->writes, writes);
+  return NULL;
+}
+
+static void bench_readers(bench_kind kind, int populated, int readers,
+                          double seconds) {
+  bench b;
+  b.kind = kind;
+  b.cht = cht_new();
+  b.ht = ht_new();
+  if (b.cht == NULL || b.ht == NULL) {
+    perror("Failed to allocate table");
+    exit(EXIT_FAILURE);
+  }
+  pthread_rwlock_init(&b.lock, NULL);
+  atomic_init(&b.stopping, 0);
+  atomic_init(&b.reads, 0);
+  atomic_init(&b.writes, 0);
+  atomic_init(&b.wrong, 0);
+
+  char value[32];
+  for (int n = 0; populated && n < BENCH_KEYS / 2; n++) {
+    value_of(value, sizeof(value), n, 0);
+    bench_insert(&b, keys[n], value);
+  }
+
+  pthread_t threads[readers + 1];
+  for (int i = 0; i < readers; i++) {
+    pthread_create(&threads[i], NULL, reader_thread, &b);
+  }
+  if (populated) {
+    pthread_create(&threads[readers], NULL, writer_thread, &b);
+  }
+
+  const double start = bench_now();
+  struct timespec wait = {(time_t)seconds,
+                          (long)((seconds - (time_t)seconds) * 1e9)};
+  nanosleep(&wait, NULL);
+  atomic_store(&b.stopping, 1);
+  for (int i = 0; i < readers + populated; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  const double elapsed = bench_now() - start;
+
+  const char *name =
+      kind == BENCH_CONCURRENT ? "concurrent table" : "rwlock + hash table";
+  printf("  %-19s %d reader(s): %7.2fM reads/s", name, readers,
+         atomic_load(&b.reads) / elapsed / 1e6);
+  if (populated) {
+    printf(", %7.1fk writes/s", atomic_load(&b.writes) / elapsed / 1e3);
+  }
+  printf(", %ld wrong\n", atomic_load(&b.wrong));
+
+  pthread_rwlock_destroy(&b.lock);
+  ht_del_hash_table(b.ht);
+  cht_del_hash_table(b.cht);
+}
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+int main(int argc, char *argv[]) {
+  const int max_readers = argc > 1 ? atoi(argv[1]) : BENCH_READERS;
+  const double seconds = argc > 2 ? atof(argv[2]) : BENCH_SECONDS;
+  if (max_readers <= 0 || seconds <= 0) {
+    fprintf(stderr, "Usage: %s [max readers] [seconds per run]\n", argv[0]);
+    return 1;
+  }
+
+  for (int n = 0; n < BENCH_KEYS; n++) {
+    key_lens[n] = snprintf(keys[n], BENCH_KEY_SIZE, "k%d", n);
+  }
+
+  bench_empty();
+
+  const char *tables[] = {"empty table, nobody writing",
+                          "populated table, one writer"};
+  for (int populated = 0; populated < 2; populated++) {
+    printf("%s:\n", tables[populated]);
+    for (int readers = 1; readers <= max_readers; readers *= 2) {
+      bench_readers(BENCH_CONCURRENT, populated, readers, seconds);
+      bench_readers(BENCH_RWLOCK, populated, readers, seconds);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,25 @@
+#!/bin/sh
+
+# Chat messages per second through the server on each I/O engine, one server
+# at a time on the same room. Run ./t.sh first, it builds the server and the
+# benchmarks. Arguments go to bench/throughput: [clients] [messages]
+# [in flight], 1 in flight is lock-step.
+set -e
+
+DIR=$(mktemp -d)
+trap 'kill $SERVER 2>/dev/null || true; rm -rf $DIR' EXIT
+
+echo "Bench,18090,./server/vocab.txt,forward,100" > $DIR/rooms.txt
+touch $DIR/corrections.txt
+
+for engine in epoll io_uring; do
+  ./tests/s -c $DIR/rooms.txt -m $DIR/corrections.txt -e $engine > $DIR/server.log 2>&1 &
+  SERVER=$!
+  sleep 1
+
+  printf "%s: " $engine
+  ./bench/throughput 18090 "$@"
+
+  kill $SERVER
+  wait $SERVER 2>/dev/null || true
+done
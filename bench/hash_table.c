@@ -0,0 +1,269 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../hash_table/hash_table.h"
+#include "bench.h"
+
+// Lookups per second of the hash table against the one it replaced, which
+// hashed a key with pow() and a modulo per character, twice per probe, and
+// kept every item in its own allocation. Hits search keys of the table,
+// misses words it doesn't have, like most words of a chat message. Both run
+// on a vocabulary file and on a large synthetic vocabulary, then the table
+// alone on a hit-heavy and a miss-heavy mix of the two.
+//
+// t.sh builds it for both backends (hash_table.h), run them on the same
+// words to compare:
+//
+//   ./bench/hash_table [vocabulary] [synthetic words]
+//   ./bench/hash_table_swiss [vocabulary] [synthetic words]
+
+#define BENCH_LOOKUPS 4000000
+#define BENCH_SYNTHETIC 500000
+#define BENCH_HIT_HEAVY 90 // % of hits
+#define BENCH_MISS_HEAVY 10
+
+// Baseline
+//
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+// The table before the rewrite, minus delete
+#define BASELINE_PRIME_1 7
+#define BASELINE_PRIME_2 11
+#define BASELINE_INITIAL_BASE_SIZE 601
+
+typedef struct {
+  char *key;
+  char *value;
+} baseline_item;
+
+typedef struct {
+  int base_size;
+  int size;
+  int count;
+  baseline_item **items;
+} baseline_table;
+
+static int baseline_next_prime(int x) {
+  for (;; x++) {
+    int prime = x >= 2;
+    for (int i = 2; prime && i * i <= x; i++) {
+      prime = x % i != 0;
+    }
+    if (prime) {
+      return x;
+    }
+  }
+}
+
+static baseline_table *baseline_new_sized(const int base_size) {
+  baseline_table *t = malloc(sizeof(baseline_table));
+  t->base_size = base_size;
+  t->size = baseline_next_prime(base_size);
+  t->count = 0;
+  t->items = calloc((size_t)t->size, sizeof(baseline_item *));
+  return t;
+}
+
+static void baseline_free(baseline_table *t) {
+  for (int i = 0; i < t->size; i++) {
+    if (t->items[i] != NULL) {
+      free(t->items[i]->key);
+      free(t->items[i]->value);
+      free(t->items[i]);
+    }
+  }
+  free(t->items);
+  free(t);
+}
+
+static int baseline_hash(const char *s, const int p, const int n) {
+  long hash = 0;
+  const int len_s = strlen(s);
+  for (int i = 0; i < len_s; i++) {
+    hash += (long)pow(p, len_s - (i + 1)) * s[i];
+    hash = hash % n;
+  }
+  return (int)hash;
+}
+
+// The step is kept below the size and the product in a long: the original
+// step could be the size itself, probing one slot forever, and overflowed
+static int baseline_get_hash(const char *s, const int num_buckets,
+                             const int attempt) {
+  const int hash_a = baseline_hash(s, BASELINE_PRIME_1, num_buckets);
+  const int hash_b = baseline_hash(s, BASELINE_PRIME_2, num_buckets);
+  return (int)((hash_a + (long)attempt * (hash_b % (num_buckets - 1) + 1)) %
+               num_buckets);
+}
+
+static void baseline_insert(baseline_table *t, const char *key,
+                            const char *value);
+
+static void baseline_resize(baseline_table *t, const int base_size) {
+  baseline_table *bigger = baseline_new_sized(base_size);
+  for (int i = 0; i < t->size; i++) {
+    if (t->items[i] != NULL) {
+      baseline_insert(bigger, t->items[i]->key, t->items[i]->value);
+    }
+  }
+
+  baseline_table old = *t;
+  *t = *bigger;
+  *bigger = old;
+  baseline_free(bigger);
+}
+
+static void baseline_insert(baseline_table *t, const char *key,
+                            const char *value) {
+  if (t->count * 100 / t->size > 70) {
+    baseline_resize(t, t->base_size * 2);
+  }
+
+  baseline_item *item = malloc(sizeof(baseline_item));
+  item->key = strdup(key);
+  item->value = strdup(value);
+
+  int index = baseline_get_hash(key, t->size, 0);
+  for (int i = 1; t->items[index] != NULL; i++) {
+    if (strcmp(t->items[index]->key, key) == 0) {
+      free(t->items[index]->key);
+      free(t->items[index]->value);
+      free(t->items[index]);
+      t->items[index] = item;
+      return;
+    }
+    index = baseline_get_hash(key, t->size, i);
+  }
+  t->items[index] = item;
+  t->count++;
+}
+
+static char *baseline_search(baseline_table *t, const char *key) {
+  int index = baseline_get_hash(key, t->size, 0);
+  for (int i = 1; t->items[index] != NULL; i++) {
+    if (strcmp(t->items[index]->key, key) == 0) {
+      return t->items[index]->value;
+    }
+    index = baseline_get_hash(key, t->size, i);
+  }
+  return NULL;
+}
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+// Words no vocabulary has, made of letters like the keys
+static char **misses_new(int count) {
+  char **misses = malloc(count * sizeof(char *));
+  for (int i = 0; i < count; i++) {
+    char word[32];
+    snprintf(word, sizeof(word), "zq%dxj", i);
+    misses[i] = strdup(word);
+  }
+  return misses;
+}
+
+static void misses_free(char **misses, int count) {
+  for (int i = 0; i < count; i++) {
+    free(misses[i]);
+  }
+  free(misses);
+}
+
+// Lookups per second of BENCH_LOOKUPS searches cycling through keys, *found
+// counts the ones that found a value
+static double lookups_baseline(baseline_table *t, char **keys, int count,
+                               long *found) {
+  *found = 0;
+  const double start = bench_now();
+  for (int i = 0; i < BENCH_LOOKUPS; i++) {
+    *found += baseline_search(t, keys[i % count]) != NULL;
+  }
+  return BENCH_LOOKUPS / (bench_now() - start);
+}
+
+static double lookups_ht(ht_hash_table *ht, char **keys, int count,
+                         long *found) {
+  *found = 0;
+  const double start = bench_now();
+  for (int i = 0; i < BENCH_LOOKUPS; i++) {
+    *found += ht_search(ht, keys[i % count]) != NULL;
+  }
+  return BENCH_LOOKUPS / (bench_now() - start);
+}
+
+// Hits and misses in random order, percent of them hits
+static char **mix_new(const bench_words *w, char **misses, int percent) {
+  char **mix = malloc(w->count * sizeof(char *));
+  unsigned seed = 1;
+  for (int i = 0; i < w->count; i++) {
+    const int n = rand_r(&seed) % w->count;
+    mix[i] = rand_r(&seed) % 100 < percent ? w->keys[n] : misses[n];
+  }
+  return mix;
+}
+
+static void bench_run(const char *name, const bench_words *w) {
+  baseline_table *baseline = baseline_new_sized(BASELINE_INITIAL_BASE_SIZE);
+  ht_hash_table *ht = ht_new();
+  if (ht == NULL) {
+    perror("Failed to allocate table");
+    exit(EXIT_FAILURE);
+  }
+  for (int i = 0; i < w->count; i++) {
+    baseline_insert(baseline, w->keys[i], w->values[i]);
+    if (ht_insert(ht, w->keys[i], w->values[i]) < 0) {
+      perror("Failed to insert");
+      exit(EXIT_FAILURE);
+    }
+  }
+  char **misses = misses_new(w->count);
+
+  long hits, found;
+  const double baseline_hits =
+      lookups_baseline(baseline, w->keys, w->count, &hits);
+  const double baseline_misses =
+      lookups_baseline(baseline, misses, w->count, &found);
+  printf("%s, %d words\n", name, w->count);
+  printf("  baseline: %.2fM hits/s, %.2fM misses/s, found %ld and %ld\n",
+         baseline_hits / 1e6, baseline_misses / 1e6, hits, found);
+
+  const double ht_hits = lookups_ht(ht, w->keys, w->count, &hits);
+  const double ht_misses = lookups_ht(ht, misses, w->count, &found);
+  printf("  %s: %.2fM hits/s (%.1fx), %.2fM misses/s (%.1fx), found %ld "
+         "and %ld\n",
+         ht_backend(), ht_hits / 1e6, ht_hits / baseline_hits,
+         ht_misses / 1e6, ht_misses / baseline_misses, hits, found);
+
+  const int percents[] = {BENCH_HIT_HEAVY, BENCH_MISS_HEAVY};
+  for (size_t i = 0; i < sizeof(percents) / sizeof(percents[0]); i++) {
+    char **mix = mix_new(w, misses, percents[i]);
+    const double rate = lookups_ht(ht, mix, w->count, &found);
+    printf("  %s, %d%% hits: %.2fM lookups/s, found %ld\n", ht_backend(),
+           percents[i], rate / 1e6, found);
+    free(mix);
+  }
+
+  misses_free(misses, w->count);
+  ht_del_hash_table(ht);
+  baseline_free(baseline);
+}
+
+int main(int argc, char *argv[]) {
+  const char *path = argc > 1 ? argv[1] : BENCH_VOCABULARY;
+  const int synthetic = argc > 2 ? atoi(argv[2]) : BENCH_SYNTHETIC;
+  if (synthetic <= 0 || synthetic > BENCH_MAX_SYNTHETIC) {
+    fprintf(stderr, "Usage: %s [vocabulary] [synthetic words]\n", argv[0]);
+    return 1;
+  }
+
+  bench_words w;
+  bench_words_load(&w, path);
+  bench_run(path, &w);
+  bench_words_free(&w);
+
+  bench_words_synthetic(&w, synthetic);
+  bench_run("synthetic", &w);
+  bench_words_free(&w);
+  return 0;
+}
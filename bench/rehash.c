@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../hash_table/hash_table.h"
+#include "../hash_table/hash_table_internal.h"
+#include "bench.h"
+
+// Latency of every insert while a table grows from empty, then of every
+// delete while it shrinks back. A resize moves HT_MIGRATE_SLOTS slots of the
+// old index per operation; t.sh also builds it moving them all at once, like
+// the rehash of the whole table it replaced, to compare the tails:
+//
+//   ./bench/rehash [keys]
+//   ./bench/rehash_whole [keys]
+//
+// Both still pay for the arena doubling (a realloc) in their slowest inserts.
+
+#define BENCH_KEYS 4000000
+#define BENCH_KEY_SIZE 32
+#define BENCH_WHOLE (1 << 30) // HT_MIGRATE_SLOTS of rehash_whole
+
+static int compare_latency(const void *a, const void *b) {
+  const double x = *(const double *)a, y = *(const double *)b;
+  return x < y ? -1 : x > y;
+}
+
+static void print_latencies(const char *operation, double *latencies,
+                            int count, double total) {
+  qsort(latencies, count, sizeof(double), compare_latency);
+  printf("%d %s in %.0f ms: p50 %.0f ns, p99 %.0f ns, p99.9 %.0f ns, "
+         "p99.99 %.0f ns, max %.2f ms\n",
+         count, operation, total * 1e3, latencies[count / 2] * 1e9,
+         latencies[(long)count * 99 / 100] * 1e9,
+         latencies[(long)count * 999 / 1000] * 1e9,
+         latencies[(long)count * 9999 / 10000] * 1e9,
+         latencies[count - 1] * 1e3);
+}
+
+int main(int argc, char *argv[]) {
+  const int count = argc > 1 ? atoi(argv[1]) : BENCH_KEYS;
+  if (count <= 0) {
+    fprintf(stderr, "Usage: %s [keys]\n", argv[0]);
+    return 1;
+  }
+
+  double *latencies = malloc(count * sizeof(double));
+  ht_hash_table *ht = ht_new();
+  if (latencies == NULL || ht == NULL) {
+    perror("Failed to allocate");
+    return 1;
+  }
+  if (HT_MIGRATE_SLOTS < BENCH_WHOLE) {
+    printf("%s, %d slots moved per operation during a resize\n",
+           ht_backend(), HT_MIGRATE_SLOTS);
+  } else {
+    printf("%s, every slot moved by the first operation of a resize\n",
+           ht_backend());
+  }
+
+  char key[BENCH_KEY_SIZE];
+  double total = 0;
+  for (int i = 0; i < count; i++) {
+    snprintf(key, sizeof(key), "word%d", i);
+    const double start = bench_now();
+    if (ht_insert(ht, key, "translation") < 0) {
+      perror("Failed to insert");
+      return 1;
+    }
+    latencies[i] = bench_now() - start;
+    total += latencies[i];
+  }
+  print_latencies("inserts", latencies, count, total);
+
+  total = 0;
+  for (int i = 0; i < count; i++) {
+    snprintf(key, sizeof(key), "word%d", i);
+    const double start = bench_now();
+    ht_delete(ht, key);
+    latencies[i] = bench_now() - start;
+    total += latencies[i];
+  }
+  print_latencies("deletes", latencies, count, total);
+
+  ht_del_hash_table(ht);
+  free(latencies);
+  return 0;
+}
@@ -0,0 +1,95 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../tests/test.h"
+
+// Chat messages per second through a running server, whatever its I/O
+// engine: bench/engines.sh runs it against one server per engine. Every
+// client keeps a number of messages in flight, sending one more as each
+// translation comes back. With one it's lock-step, the rate is bound by the
+// round trips; with more the client pipelines and the server batches what
+// one read brings. Clients share one room and every message also goes to the
+// others.
+//
+//   ./bench/throughput port [clients] [messages per client] [in flight]
+
+#define BENCH_CLIENTS 4
+#define BENCH_MESSAGES 20000
+#define BENCH_BODY "hello you thing"
+#define BENCH_USAGE                                                           \
+  "Usage: %s port [clients] [messages per client] [in flight]\n"
+
+typedef struct {
+  pthread_t thread;
+  int port;
+  int id;
+  long messages;
+  long in_flight;
+} bench_client;
+
+static double now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void *client_run(void *arg) {
+  bench_client *b = arg;
+  char username[32], out[PROTO_MAX_BODY + 1];
+  snprintf(username, sizeof(username), "bench%d", b->id);
+
+  test_client *c = test_connect(b->port);
+  long sent = 0;
+  for (; sent < b->in_flight && sent < b->messages; sent++) {
+    test_send(c, username, BENCH_BODY);
+  }
+  for (long received = 0; received < b->messages; received++) {
+    TEST_CHECK(test_receive(c, username, out, sizeof(out)) >= 0,
+               "connection closed after %ld messages", received);
+    if (sent < b->messages) {
+      test_send(c, username, BENCH_BODY);
+      sent++;
+    }
+  }
+  test_close(c);
+  return NULL;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    fprintf(stderr, BENCH_USAGE, argv[0]);
+    return 1;
+  }
+  const int port = atoi(argv[1]);
+  const int clients = argc > 2 ? atoi(argv[2]) : BENCH_CLIENTS;
+  const long messages = argc > 3 ? atol(argv[3]) : BENCH_MESSAGES;
+  const long in_flight = argc > 4 ? atol(argv[4]) : 1;
+  if (clients <= 0 || messages <= 0 || in_flight <= 0) {
+    fprintf(stderr, BENCH_USAGE, argv[0]);
+    return 1;
+  }
+
+  bench_client *b = calloc(clients, sizeof(bench_client));
+  TEST_CHECK(b != NULL, "out of memory");
+
+  const double start = now();
+  for (int i = 0; i < clients; i++) {
+    b[i].port = port;
+    b[i].id = i;
+    b[i].messages = messages;
+    b[i].in_flight = in_flight;
+    pthread_create(&b[i].thread, NULL, client_run, &b[i]);
+  }
+  for (int i = 0; i < clients; i++) {
+    pthread_join(b[i].thread, NULL);
+  }
+  const double elapsed = now() - start;
+
+  printf("%d client(s), %ld messages each, %ld in flight: %.0f msg/s\n",
+         clients, messages, in_flight, clients * messages / elapsed);
+  free(b);
+  return 0;
+}
@@ -0,0 +1,205 @@
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../worker_pool/worker_pool.h"
+
+// Jobs per second of the worker pool against the single queue it replaced, a
+// list behind a mutex and a condition variable. Every root job submitted by
+// the main thread spawns BENCH_CHILDREN jobs, like a translation job turning
+// into fan-out: the pool keeps them on the worker's deque, the single queue
+// makes every worker contend for the same lock.
+//
+//   ./bench/worker_pool [root jobs]
+
+#define BENCH_ROOTS 200000
+#define BENCH_CHILDREN 4
+
+typedef struct bench bench;
+
+typedef struct bench_job {
+  worker_job base;
+  struct bench_job *next; // in the mutex queue
+  bench *b;
+  struct bench_job *children; // NULL for a child
+} bench_job;
+
+struct bench {
+  void (*submit)(bench *b, bench_job *job);
+  worker_pool pool;
+
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  bench_job *head;
+  bench_job *tail;
+  int stopping;
+
+  atomic_long remaining;
+  sem_t done;
+};
+
+static double now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void job_run(worker_job *job) {
+  bench_job *j = (bench_job *)job;
+  bench *b = j->b;
+  if (j->children != NULL) {
+    for (int i = 0; i < BENCH_CHILDREN; i++) {
+      b->submit(b, &j->children[i]);
+    }
+  }
+  if (atomic_fetch_sub_explicit(&b->remaining, 1, memory_order_acq_rel) == 1) {
+    sem_post(&b->done);
+  }
+}
+
+static void pool_submit(bench *b, bench_job *job) {
+  worker_pool_submit(&b->pool, &job->base);
+}
+
+// Mutex queue
+//
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+static void mutex_submit(bench *b, bench_job *job) {
+  job->next = NULL;
+  pthread_mutex_lock(&b->lock);
+  if (b->tail == NULL) {
+    b->head = job;
+  } else {
+    b->tail->next = job;
+  }
+  b->tail = job;
+  pthread_cond_signal(&b->not_empty);
+  pthread_mutex_unlock(&b->lock);
+}
+
+static void *mutex_worker(void *arg) {
+  bench *b = arg;
+  for (;;) {
+    pthread_mutex_lock(&b->lock);
+    while (b->head == NULL && !b->stopping) {
+      pthread_cond_wait(&b->not_empty, &b->lock);
+    }
+    bench_job *job = b->head;
+    if (job == NULL) {
+      pthread_mutex_unlock(&b->lock);
+      return NULL;
+    }
+    b->head = job->next;
+    if (b->head == NULL) {
+      b->tail = NULL;
+    }
+    pthread_mutex_unlock(&b->lock);
+
+    job->base.run(&job->base);
+  }
+}
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+// Jobs per second from the first submission to the last job done
+static double bench_run(bench *b, bench_job *roots, bench_job *children,
+                        long root_count) {
+  for (long i = 0; i < root_count; i++) {
+    roots[i].base.run = job_run;
+    roots[i].b = b;
+    roots[i].children = &children[i * BENCH_CHILDREN];
+    for (int c = 0; c < BENCH_CHILDREN; c++) {
+      bench_job *child = &children[i * BENCH_CHILDREN + c];
+      child->base.run = job_run;
+      child->b = b;
+      child->children = NULL;
+    }
+  }
+  atomic_store(&b->remaining, root_count * (1 + BENCH_CHILDREN));
+  sem_init(&b->done, 0, 0);
+
+  const double start = now();
+  for (long i = 0; i < root_count; i++) {
+    b->submit(b, &roots[i]);
+  }
+  sem_wait(&b->done);
+  const double elapsed = now() - start;
+
+  sem_destroy(&b->done);
+  return root_count * (1 + BENCH_CHILDREN) / elapsed;
+}
+
+static double bench_pool(bench_job *roots, bench_job *children,
+                         long root_count, int workers) {
+  bench b;
+  b.submit = pool_submit;
+  // Room for every root, none is run by the main thread
+  if (worker_pool_init(&b.pool, workers, root_count) < 0) {
+    perror("Failed to create worker pool");
+    exit(1);
+  }
+  const double rate = bench_run(&b, roots, children, root_count);
+  worker_pool_destroy(&b.pool);
+  return rate;
+}
+
+static double bench_mutex(bench_job *roots, bench_job *children,
+                          long root_count, int workers) {
+  bench b;
+  b.submit = mutex_submit;
+  pthread_mutex_init(&b.lock, NULL);
+  pthread_cond_init(&b.not_empty, NULL);
+  b.head = NULL;
+  b.tail = NULL;
+  b.stopping = 0;
+
+  pthread_t threads[workers];
+  for (int i = 0; i < workers; i++) {
+    pthread_create(&threads[i], NULL, mutex_worker, &b);
+  }
+  const double rate = bench_run(&b, roots, children, root_count);
+
+  pthread_mutex_lock(&b.lock);
+  b.stopping = 1;
+  pthread_cond_broadcast(&b.not_empty);
+  pthread_mutex_unlock(&b.lock);
+  for (int i = 0; i < workers; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  pthread_cond_destroy(&b.not_empty);
+  pthread_mutex_destroy(&b.lock);
+  return rate;
+}
+
+int main(int argc, char *argv[]) {
+  const long root_count = argc > 1 ? atol(argv[1]) : BENCH_ROOTS;
+  if (root_count <= 0) {
+    fprintf(stderr, "Usage: %s [root jobs]\n", argv[0]);
+    return 1;
+  }
+
+  bench_job *roots = malloc(root_count * sizeof(bench_job));
+  bench_job *children =
+      malloc(root_count * BENCH_CHILDREN * sizeof(bench_job));
+  if (roots == NULL || children == NULL) {
+    perror("Failed to allocate jobs");
+    return 1;
+  }
+
+  printf("%ld root jobs, %d children each\n", root_count, BENCH_CHILDREN);
+  const int workers[] = {1, 2, 4};
+  for (size_t i = 0; i < sizeof(workers) / sizeof(workers[0]); i++) {
+    const double stealing =
+        bench_pool(roots, children, root_count, workers[i]);
+    const double mutex = bench_mutex(roots, children, root_count, workers[i]);
+    printf("%d worker(s): %.2fM jobs/s work stealing, %.2fM jobs/s mutex\n",
+           workers[i], stealing / 1e6, mutex / 1e6);
+  }
+
+  free(children);
+  free(roots);
+  return 0;
+}
@@ -0,0 +1,86 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "bloom.h"
+
+// Odd constants, one per word of a block: multiplied by the low half of the
+// hash, their top 6 bits pick the bit of the word
+static const uint32_t bloom_salts[8] = {
+    0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+    0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U,
+};
+
+bloom_filter *bloom_new(size_t keys) {
+  bloom_filter *b = malloc(sizeof(bloom_filter));
+  if (b == NULL) {
+    return NULL;
+  }
+
+  const size_t bits = sizeof(bloom_block) * 8;
+  b->block_count = (keys * BLOOM_BITS_PER_KEY + bits - 1) / bits;
+  if (b->block_count == 0) {
+    b->block_count = 1;
+  }
+
+  b->blocks = aligned_alloc(sizeof(bloom_block),
+                            b->block_count * sizeof(bloom_block));
+  if (b->blocks == NULL) {
+    free(b);
+    return NULL;
+  }
+  memset(b->blocks, 0, b->block_count * sizeof(bloom_block));
+  return b;
+}
+
+void bloom_free(bloom_filter *b) {
+  if (b == NULL) {
+    return;
+  }
+
+  free(b->blocks);
+  free(b);
+}
+
+// The high half of the hash picks the block, by multiplying instead of a
+// modulo so any number of blocks works
+static inline bloom_block *bloom_block_of(const bloom_filter *b,
+                                          const uint64_t hash) {
+  return &b->blocks[((hash >> 32) * b->block_count) >> 32];
+}
+
+static inline uint64_t bloom_bit(const uint64_t hash, const int word) {
+  return 1ULL << (((uint32_t)hash * bloom_salts[word]) >> 26);
+}
+
+void bloom_add(bloom_filter *b, uint64_t hash) {
+  bloom_block *block = bloom_block_of(b, hash);
+  for (int i = 0; i < 8; i++) {
+    block->words[i] |= bloom_bit(hash, i);
+  }
+}
+
+// Every word is tested, with no early exit: the 8 tests don't wait for each
+// other and the line is read once anyway
+int bloom_may_contain(const bloom_filter *b, uint64_t hash) {
+  const bloom_block *block = bloom_block_of(b, hash);
+  uint64_t missing = 0;
+  for (int i = 0; i < 8; i++) {
+    const uint64_t bit = bloom_bit(hash, i);
+    missing |= ~block->words[i] & bit;
+  }
+  return missing == 0;
+}
+
+// A hash lands in every block as often: the rate is the average over the
+// blocks of the odds that its 8 bits are all set there
+double bloom_false_positive_rate(const bloom_filter *b) {
+  double total = 0;
+  for (size_t i = 0; i < b->block_count; i++) {
+    double odds = 1;
+    for (int w = 0; w < 8; w++) {
+      odds *= __builtin_popcountll(b->blocks[i].words[w]) / 64.0;
+    }
+    total += odds;
+  }
+  return total / b->block_count;
+}
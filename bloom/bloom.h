@@ -0,0 +1,44 @@
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Blocked Bloom filter over 64-bit hashes, for telling a key is surely not
+// in a table before probing it. A hash picks one block of 64 bytes, one
+// cache line, and one bit in each of its 8 words: a lookup reads that line
+// only, whatever the size of the filter. A key that was added is always
+// found, one that wasn't is found with the false positive rate.
+//
+// Hashes go in as they are, the ones of the table the filter stands in
+// front of: nothing is hashed again.
+
+#define BLOOM_BITS_PER_KEY 12
+
+typedef struct {
+  uint64_t words[8];
+} bloom_block;
+
+typedef struct {
+  bloom_block *blocks; // 64 bytes aligned
+  size_t block_count;
+} bloom_filter;
+
+// Sized for keys, BLOOM_BITS_PER_KEY bits each. More keys can be added, the
+// false positive rate grows with them.
+bloom_filter *bloom_new(size_t keys);
+void bloom_free(bloom_filter *b);
+
+void bloom_add(bloom_filter *b, uint64_t hash);
+
+// 0 when the hash was never added
+int bloom_may_contain(const bloom_filter *b, uint64_t hash);
+
+// Odds a hash never added is found, from the bits set in every block
+double bloom_false_positive_rate(const bloom_filter *b);
+
+static inline size_t bloom_size(const bloom_filter *b) {
+  return b->block_count * sizeof(bloom_block);
+}
+
+#endif // BLOOM_H
@@ -0,0 +1,233 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "../hash_table/hash_table_internal.h"
+#include "cache.h"
+
+// Buckets are sized for entries this big on average, short chat messages
+#define CACHE_AVERAGE_ENTRY 128
+#define CACHE_MIN_BUCKETS 16
+
+static inline uint64_t cache_hash(const uint64_t tag, const char *key,
+                                  const size_t key_len) {
+  return ht_mix(ht_hash(key, key_len) ^ HT_SECRET_2, tag ^ HT_SECRET_1);
+}
+
+// The top bits pick the shard, the low ones the bucket, the ones above them
+// the place in the seen table
+static inline cache_shard *cache_shard_of(cache *c, const uint64_t hash) {
+  return &c->shards[hash >> 60 & (CACHE_SHARDS - 1)];
+}
+
+static inline size_t cache_entry_size(const cache_entry *e) {
+  return sizeof(cache_entry) + e->key_len + e->value_len;
+}
+
+int cache_init(cache *c, size_t capacity) {
+  c->capacity = capacity;
+
+  size_t buckets = CACHE_MIN_BUCKETS;
+  while (buckets * CACHE_AVERAGE_ENTRY < capacity / CACHE_SHARDS) {
+    buckets *= 2;
+  }
+
+  for (int i = 0; i < CACHE_SHARDS; i++) {
+    cache_shard *s = &c->shards[i];
+    s->buckets = calloc(buckets, sizeof(cache_entry *));
+    if (s->buckets == NULL) {
+      while (i-- > 0) {
+        pthread_rwlock_destroy(&c->shards[i].lock);
+        free(c->shards[i].buckets);
+      }
+      return -1;
+    }
+
+    pthread_rwlock_init(&s->lock, NULL);
+    s->mask = buckets - 1;
+    s->hand = NULL;
+    s->count = 0;
+    s->bytes = 0;
+    s->capacity = capacity / CACHE_SHARDS;
+    for (int j = 0; j < CACHE_SEEN; j++) {
+      atomic_init(&s->seen[j], 0);
+    }
+    atomic_init(&s->hits, 0);
+    atomic_init(&s->misses, 0);
+    atomic_init(&s->rejections, 0);
+    s->evictions = 0;
+  }
+  return 0;
+}
+
+void cache_destroy(cache *c) {
+  for (int i = 0; i < CACHE_SHARDS; i++) {
+    cache_shard *s = &c->shards[i];
+    for (size_t b = 0; b <= s->mask; b++) {
+      cache_entry *e = s->buckets[b];
+      while (e != NULL) {
+        cache_entry *next = e->next;
+        free(e);
+        e = next;
+      }
+    }
+
+    free(s->buckets);
+    pthread_rwlock_destroy(&s->lock);
+  }
+}
+
+// With the lock of the shard held
+static cache_entry *cache_find(const cache_shard *s, const uint64_t hash,
+                               const uint64_t tag, const char *key,
+                               const size_t key_len) {
+  for (cache_entry *e = s->buckets[hash & s->mask]; e != NULL; e = e->next) {
+    if (e->hash == hash && e->tag == tag && e->key_len == key_len &&
+        memcmp(e->data, key, key_len) == 0) {
+      return e;
+    }
+  }
+  return NULL;
+}
+
+long cache_get(cache *c, uint64_t tag, const char *key, size_t key_len,
+               char *out, size_t out_size) {
+  const uint64_t hash = cache_hash(tag, key, key_len);
+  cache_shard *s = cache_shard_of(c, hash);
+  long len = -1;
+
+  pthread_rwlock_rdlock(&s->lock);
+  cache_entry *e = cache_find(s, hash, tag, key, key_len);
+  if (e != NULL && e->value_len <= out_size) {
+    // Only ever set here and cleared by the hand, a plain store is enough
+    if (!atomic_load_explicit(&e->referenced, memory_order_relaxed)) {
+      atomic_store_explicit(&e->referenced, 1, memory_order_relaxed);
+    }
+    memcpy(out, e->data + e->key_len, e->value_len);
+    len = e->value_len;
+  }
+  pthread_rwlock_unlock(&s->lock);
+
+  atomic_fetch_add_explicit(len >= 0 ? &s->hits : &s->misses, 1,
+                            memory_order_relaxed);
+  return len;
+}
+
+// Clock
+//
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+// With the write lock of the shard held. The hand goes round at most twice:
+// the first time round unmarks every entry it passes.
+static void cache_evict_one(cache_shard *s) {
+  cache_entry *e = s->hand;
+  while (atomic_exchange_explicit(&e->referenced, 0, memory_order_relaxed)) {
+    e = e->clock_next;
+  }
+
+  cache_entry **link = &s->buckets[e->hash & s->mask];
+  while (*link != e) {
+    link = &(*link)->next;
+  }
+  *link = e->next;
+
+  if (e->clock_next == e) {
+    s->hand = NULL;
+  } else {
+    e->clock_prev->clock_next = e->clock_next;
+    e->clock_next->clock_prev = e->clock_prev;
+    s->hand = e->clock_next;
+  }
+
+  s->count--;
+  s->bytes -= cache_entry_size(e);
+  s->evictions++;
+  free(e);
+}
+
+// Just behind the hand, the last entry it gets to
+static void cache_clock_insert(cache_shard *s, cache_entry *e) {
+  if (s->hand == NULL) {
+    e->clock_next = e;
+    e->clock_prev = e;
+    s->hand = e;
+    return;
+  }
+
+  e->clock_next = s->hand;
+  e->clock_prev = s->hand->clock_prev;
+  e->clock_prev->clock_next = e;
+  s->hand->clock_prev = e;
+}
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+void cache_put(cache *c, uint64_t tag, const char *key, size_t key_len,
+               const char *value, size_t value_len) {
+  const uint64_t hash = cache_hash(tag, key, key_len);
+  cache_shard *s = cache_shard_of(c, hash);
+
+  const size_t size = sizeof(cache_entry) + key_len + value_len;
+  if (size > s->capacity || key_len > UINT32_MAX || value_len > UINT32_MAX) {
+    return;
+  }
+
+  // Two keys sharing a place push each other out, and a lost race only
+  // delays an admission: no lock needed
+  _Atomic(uint64_t) *seen = &s->seen[hash >> 32 & (CACHE_SEEN - 1)];
+  if (atomic_load_explicit(seen, memory_order_relaxed) != hash) {
+    atomic_store_explicit(seen, hash, memory_order_relaxed);
+    atomic_fetch_add_explicit(&s->rejections, 1, memory_order_relaxed);
+    return;
+  }
+
+  // Built before taking the lock, only linking it in is done holding it
+  cache_entry *e = malloc(size);
+  if (e == NULL) {
+    return;
+  }
+  e->hash = hash;
+  e->tag = tag;
+  atomic_init(&e->referenced, 0);
+  e->key_len = (uint32_t)key_len;
+  e->value_len = (uint32_t)value_len;
+  memcpy(e->data, key, key_len);
+  memcpy(e->data + key_len, value, value_len);
+
+  pthread_rwlock_wrlock(&s->lock);
+  // Another thread missed the same key and got here first
+  if (cache_find(s, hash, tag, key, key_len) != NULL) {
+    pthread_rwlock_unlock(&s->lock);
+    free(e);
+    return;
+  }
+
+  while (s->bytes + size > s->capacity) {
+    cache_evict_one(s);
+  }
+
+  cache_entry **bucket = &s->buckets[hash & s->mask];
+  e->next = *bucket;
+  *bucket = e;
+  cache_clock_insert(s, e);
+  s->count++;
+  s->bytes += size;
+  pthread_rwlock_unlock(&s->lock);
+}
+
+void cache_stats_get(cache *c, cache_stats *stats) {
+  memset(stats, 0, sizeof(cache_stats));
+  stats->capacity = c->capacity;
+
+  for (int i = 0; i < CACHE_SHARDS; i++) {
+    cache_shard *s = &c->shards[i];
+    pthread_rwlock_rdlock(&s->lock);
+    stats->entries += s->count;
+    stats->bytes += s->bytes;
+    stats->evictions += s->evictions;
+    pthread_rwlock_unlock(&s->lock);
+
+    stats->hits += atomic_load_explicit(&s->hits, memory_order_relaxed);
+    stats->misses += atomic_load_explicit(&s->misses, memory_order_relaxed);
+    stats->rejections +=
+        atomic_load_explicit(&s->rejections, memory_order_relaxed);
+  }
+}
@@ -0,0 +1,90 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Bounded cache of byte strings, for results worth keeping because the same
+// input keeps coming back (the translation of "Ciao!"). A key is a tag
+// saying what the bytes are looked up in, then the bytes themselves.
+//
+// Entries are spread over shards by hash, every shard has its own lock, so
+// threads looking up different keys rarely wait for each other. A hit only
+// takes the read lock of its shard and marks the entry referenced. Eviction
+// is CLOCK: a hand goes round the entries of the shard, a referenced entry
+// is unmarked and passed, the first one not used since the hand last went by
+// is evicted. What's hit often stays, as with LRU, without moving anything
+// on a hit. The size limit is in bytes, entries included.
+//
+// Most keys are never seen again, so a key is only admitted the second time
+// it's put: the first time only its hash is remembered, in a small table
+// without a lock. Keys seen once cost no allocation and evict nothing.
+
+#define CACHE_SHARDS 16
+#define CACHE_SEEN 1024 // hashes remembered per shard
+
+typedef struct cache_entry cache_entry;
+
+struct cache_entry {
+  cache_entry *next; // in the bucket
+  cache_entry *clock_next;
+  cache_entry *clock_prev;
+  uint64_t hash;
+  uint64_t tag;
+  atomic_int referenced;
+  uint32_t key_len;
+  uint32_t value_len;
+  char data[]; // key then value, no NUL
+};
+
+typedef struct {
+  pthread_rwlock_t lock;
+  cache_entry **buckets;
+  size_t mask;
+  cache_entry *hand; // next entry the clock looks at, NULL when empty
+  size_t count;
+  size_t bytes;
+  size_t capacity;
+
+  _Atomic(uint64_t) seen[CACHE_SEEN]; // hashes put once, direct mapped
+
+  atomic_ulong hits;
+  atomic_ulong misses;
+  atomic_ulong rejections; // put once so far, not admitted
+  unsigned long evictions; // with the write lock held
+} cache_shard;
+
+typedef struct {
+  cache_shard shards[CACHE_SHARDS];
+  size_t capacity;
+} cache;
+
+typedef struct {
+  size_t entries;
+  size_t bytes;
+  size_t capacity;
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long rejections;
+  unsigned long evictions;
+} cache_stats;
+
+// At most capacity bytes, spread evenly over the shards
+int cache_init(cache *c, size_t capacity);
+void cache_destroy(cache *c);
+
+// Copy the value of (tag, key) into out. Returns its length, or -1 when it
+// isn't cached or doesn't fit in out_size.
+long cache_get(cache *c, uint64_t tag, const char *key, size_t key_len,
+               char *out, size_t out_size);
+
+// Keep the value of (tag, key) if it was put before, evicting what it takes
+// to stay in the limit. A key already cached keeps its value.
+void cache_put(cache *c, uint64_t tag, const char *key, size_t key_len,
+               const char *value, size_t value_len);
+
+void cache_stats_get(cache *c, cache_stats *stats);
+
+#endif // CACHE_H
@@ -3,14 +3,17 @@
 #include <netdb.h>
 #include <pthread.h>
 #include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
 #include <termios.h>
 #include <time.h>
 #include <unistd.h>
 
 #include "../auth/user_auth.h"
+#include "../protocol/protocol.h"
 
 // Local ip to uncomment if using local dev environment
 #define SERVER_IP "127.0.0.1"
@@ -24,12 +27,18 @@
 #define GREEN_COLOR "\033[0;32m"
 #define RESET_COLOR "\033[0m"
 #define MAX_INACTIVE_TIME_IN_SECONDS 10
+#define ROOM_DISCONNECTED -1
 
 atomic_bool is_in_room = false;
 atomic_bool should_kick_inactive_user = false;
 atomic_int_least64_t last_activity_time;
 
+// Last room state announced by the server: 0, PROTO_LOCKED, PROTO_NOT_LOCKED
+// or ROOM_DISCONNECTED, written by the receiver thread
+atomic_int room_status = 0;
+
 pthread_t inactivity_thread;
+pthread_t receiver_thread;
 
 // Instead of system("clear") use this
 void clear_screen() {
@@ -100,6 +109,103 @@ char getch() {
 }
 // +++++++++++++++++++++++++++++++++++++++++++++++++++++++
 
+// Framed messages
+//
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+int send_frame(int sockfd, proto_type type, const char *username,
+               const char *body) {
+  char frame[PROTO_MAX_FRAME];
+  size_t size = proto_encode(frame, sizeof(frame), type, 0, username,
+                             username ? strlen(username) : 0, body,
+                             body ? strlen(body) : 0);
+  if (size == 0) {
+    errno = EMSGSIZE;
+    return -1;
+  }
+
+  size_t sent = 0;
+  while (sent < size) {
+    ssize_t bytes_sent = send(sockfd, frame + sent, size - sent, 0);
+    if (bytes_sent < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    sent += bytes_sent;
+  }
+
+  return 0;
+}
+
+// Wait for the next frame from the server: 1 when frame is filled, 0 if the
+// server disconnected, -1 on error
+int recv_frame(int sockfd, proto_parser *parser, proto_frame *frame) {
+  char buffer[BUFSIZE];
+
+  while (1) {
+    int res = proto_parser_next(parser, frame);
+    if (res > 0) {
+      return 1;
+    }
+    if (res < 0) {
+      errno = EPROTO;
+      return -1;
+    }
+
+    ssize_t bytes_received = recv(sockfd, buffer, sizeof(buffer), 0);
+    if (bytes_received <= 0) {
+      return bytes_received;
+    }
+
+    // Less than a frame is left in the parser, so a recv always fits
+    proto_parser_feed(parser, buffer, bytes_received);
+  }
+}
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+// Receiving messages
+//
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+// Messages are sent without waiting for an answer, so many of them can be in
+// flight at once; everything the server sends is read by this thread
+void *receiver_thread_run(void *arg) {
+  int sockfd = (int)(intptr_t)arg;
+  proto_parser parser;
+  proto_frame frame;
+
+  proto_parser_init(&parser);
+
+  while (recv_frame(sockfd, &parser, &frame) > 0) {
+    if (frame.type == PROTO_CHAT) {
+      printf("\r%.*s: %.*s\n", (int)frame.username_len, frame.username,
+             (int)frame.body_len, frame.body);
+      fflush(stdout);
+    } else if (frame.type == PROTO_LOCKED || frame.type == PROTO_NOT_LOCKED) {
+      atomic_store(&room_status, frame.type);
+    }
+  }
+
+  atomic_store(&room_status, ROOM_DISCONNECTED);
+  return NULL;
+}
+
+int start_receiver(int sockfd) {
+  atomic_store(&room_status, 0);
+  return pthread_create(&receiver_thread, NULL, receiver_thread_run,
+                        (void *)(intptr_t)sockfd);
+}
+
+// Close the connection, the receiver thread stops as soon as it sees it
+void disconnect_from_server(int sockfd) {
+  shutdown(sockfd, SHUT_RDWR);
+  pthread_join(receiver_thread, NULL);
+  close(sockfd);
+}
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
 // Room selection
 //
 // +++++++++++++++++++++++++++++++++++++++++++++++++++++++
@@ -367,7 +473,6 @@ void login_or_registration_selection(user **user) {
 
 int main() {
   int sockfd = -1;
-  char server_response_buffer[BUFSIZE];
   char message_buffer[BUFSIZE];
   int room_choice;
   user *user = NULL;
@@ -389,6 +494,12 @@ int main() {
       }
     } while (sockfd < 0);
 
+    if (start_receiver(sockfd) != 0) {
+      perror("Failed to create receiver thread");
+      close(sockfd);
+      break;
+    }
+
     atomic_store(&is_in_room, true);
 
     update_activity_time();
@@ -404,8 +515,8 @@ int main() {
            !atomic_load(&should_kick_inactive_user)) {
 
       // Get user input
-      int username_length = strlen(user->username);
-      char message_with_user[BUFSIZE + username_length + 4];
+      char sender[MAX_USERNAME_LENGTH + MAX_LANGUAGE_LENGTH + 4];
+      const char *body = message_buffer;
 
       // Loop till the message is empty or only contains whitespace
       do {
@@ -415,58 +526,13 @@ int main() {
 
       update_activity_time();
 
-      if (atomic_load(&should_kick_inactive_user)) {
-        snprintf(message_with_user, sizeof(message_with_user),
-                 "%s: \033[0;31m%s\033[0m", user->username,
-                 "Has been kicked out of the room!");
-      } else {
-        snprintf(message_with_user, sizeof(message_with_user), "%s (%s): %s",
-                 user->username, user->language, message_buffer);
-      }
-
-      message_with_user[strcspn(message_with_user, "\n")] = '\0';
-
-      if (send(sockfd, message_with_user, strlen(message_with_user), 0) < 0) {
-        perror("send failed");
+      if (atomic_load(&room_status) == ROOM_DISCONNECTED) {
+        printf("Server disconnected.\n");
         break;
       }
 
-      // When /ciao is sent, close current connection and go back to room
-      // selection
-      if (strcmp(message_buffer, "/ciao") == 0 ||
-          strcmp(message_buffer, "/exit") == 0) {
-        printf("Disconnecting from current room...\n");
-
-        atomic_store(&is_in_room, false);
-        pthread_join(inactivity_thread, NULL);
-
-        close(sockfd);
-
-        sleep(1);
-        break;
-      }
-
-      // Receive response from server
-      //
-      memset(server_response_buffer, 0, BUFSIZE);
-      int bytes_received_room_locked =
-          recv(sockfd, server_response_buffer, BUFSIZE - 1, 0);
-      if (bytes_received_room_locked <= 0) {
-        if (bytes_received_room_locked == 0) {
-          printf("Server disconnected.\n");
-        } else {
-          perror("recv failed");
-        }
-        close(sockfd);
-        break;
-      }
-
-      server_response_buffer[bytes_received_room_locked] = '\0';
-
-      // printf("Server response: %s\n", server_response_buffer);
-
       // Waiting queue if the room is full = locked
-      if (strcmp(server_response_buffer, "LOCKED") == 0) {
+      if (atomic_load(&room_status) == PROTO_LOCKED) {
         printf("Can't send the message because the server room is full, try "
                "again after some time.\n");
         printf("---------------------------------------------------------\n");
@@ -490,54 +556,81 @@ int main() {
 
             printf("You are in queue now, wait for your turn...\n");
 
-            memset(server_response_buffer, 0, BUFSIZE);
-            int bytes_received_queue =
-                recv(sockfd, server_response_buffer, BUFSIZE - 1, 0);
-            if (bytes_received_queue <= 0) {
-              if (bytes_received_queue == 0) {
-                printf("Server disconnected.\n");
-              } else {
-                perror("recv failed");
-              }
-              close(sockfd);
-              break;
+            while (atomic_load(&room_status) == PROTO_LOCKED) {
+              usleep(100 * 1000);
             }
 
-            server_response_buffer[bytes_received_queue] = '\0';
-
-            if (strcmp(server_response_buffer, "LOCKED") == 0) {
-              printf("Room is full, still waiting...\n");
-              sleep(1);
-            } else {
-              sockfd = connect_to_server(room_choice);
+            if (atomic_load(&room_status) == ROOM_DISCONNECTED) {
+              printf("Server disconnected.\n");
+              break;
+            }
 
-              atomic_store(&is_in_room, true);
+            disconnect_from_server(sockfd);
+            sockfd = connect_to_server(room_choice);
+            if (sockfd < 0 || start_receiver(sockfd) != 0) {
+              printf("Failed to connect.\n");
+              if (sockfd >= 0) {
+                close(sockfd);
+              }
+              sockfd = -1;
+              break;
+            }
 
-              update_activity_time();
+            atomic_store(&is_in_room, true);
 
-              if (pthread_create(&inactivity_thread, NULL,
-                                 inactivity_check_thread, NULL) != 0) {
-                perror("Failed to create inactivity check thread");
-              }
+            update_activity_time();
 
-              break;
+            if (pthread_create(&inactivity_thread, NULL,
+                               inactivity_check_thread, NULL) != 0) {
+              perror("Failed to create inactivity check thread");
             }
+
+            break;
           }
         } while (exit_choice != 'q');
 
-        if (strcmp(server_response_buffer, "LOCKED") == 0) {
+        if (!atomic_load(&is_in_room)) {
           break;
         }
+
+        // The message typed while locked is not sent, the new seat starts
+        // clean
+        continue;
+      }
+
+      if (atomic_load(&should_kick_inactive_user)) {
+        snprintf(sender, sizeof(sender), "%s", user->username);
+        body = "\033[0;31mHas been kicked out of the room!\033[0m";
+      } else {
+        snprintf(sender, sizeof(sender), "%s (%s)", user->username,
+                 user->language);
+      }
+
+      // No waiting for the answer: the receiver thread prints it whenever it
+      // comes, so the next message can go out right away
+      if (send_frame(sockfd, PROTO_CHAT, sender, body) < 0) {
+        perror("send failed");
+        break;
+      }
+
+      // When /ciao is sent, close current connection and go back to room
+      // selection
+      if (strcmp(message_buffer, "/ciao") == 0 ||
+          strcmp(message_buffer, "/exit") == 0) {
+        printf("Disconnecting from current room...\n");
+
+        atomic_store(&is_in_room, false);
+        pthread_join(inactivity_thread, NULL);
+
+        sleep(1);
+        break;
       }
 
       if (atomic_load(&should_kick_inactive_user)) {
         printf("You have been kicked from the room due to inactivity.\n");
         printf("Redirecting you to room selection...\n");
 
-        memset(message_buffer, 0, BUFSIZE);
-        strcpy(message_buffer, "KICKED");
-
-        if (send(sockfd, message_buffer, strlen(message_buffer), 0) < 0) {
+        if (send_frame(sockfd, PROTO_KICKED, NULL, NULL) < 0) {
           perror("send failed");
           break;
         }
@@ -547,6 +640,11 @@ int main() {
       }
     }
 
+    if (sockfd >= 0) {
+      disconnect_from_server(sockfd);
+      sockfd = -1;
+    }
+
     atomic_store(&should_kick_inactive_user, false);
     atomic_store(&is_in_room, false);
     pthread_join(inactivity_thread, NULL);
@@ -1,181 +1,316 @@
-#include <math.h>
+#include <errno.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "hash_table.h"
-#include "prime.h"
+#include "hash_table_internal.h"
 
-#define HT_PRIME_1 7
-#define HT_PRIME_2 11
-#define HT_INITIAL_BASE_SIZE 601
+#ifndef HT_SWISS
 
-static ht_item HT_DELETED_ITEM = {NULL, NULL};
+#define HT_INITIAL_SIZE 1024
 
-static void ht_resize_up(ht_hash_table *ht);
-static void ht_resize_down(ht_hash_table *ht);
+static int ht_resize(ht_hash_table *ht, const int size);
 
-static ht_item *ht_new_item(const char *k, const char *v) {
-  ht_item *i = malloc(sizeof(ht_item));
-  i->key = strdup(k);
-  i->value = strdup(v);
-  return i;
+static int ht_index_init(ht_index *index, const int size) {
+  index->size = size;
+  index->count = 0;
+  index->deleted = 0;
+  index->slots = calloc((size_t)size, sizeof(ht_slot));
+  return index->slots != NULL ? 0 : -1;
 }
 
-static void ht_del_item(ht_item *i) {
-  free(i->key);
-  free(i->value);
-  free(i);
+static void ht_index_free(ht_index *index) {
+  free(index->slots);
+  index->slots = NULL;
 }
 
-static ht_hash_table *ht_new_sized(const int base_size) {
+ht_hash_table *ht_new() {
   ht_hash_table *ht = malloc(sizeof(ht_hash_table));
-  ht->base_size = base_size;
-
-  ht->size = next_prime(ht->base_size);
+  if (ht == NULL) {
+    return NULL;
+  }
 
-  ht->count = 0;
-  ht->items = calloc((size_t)ht->size, sizeof(ht_item *));
+  memset(&ht->old, 0, sizeof(ht->old));
+  ht->old_position = 0;
+
+  // Offset 0 means an empty slot, so the arena starts with one unused byte
+  ht->arena_capacity = HT_INITIAL_ARENA;
+  ht->arena = malloc(ht->arena_capacity);
+  ht->arena_len = 1;
+  ht->arena_garbage = 0;
+  ht->filter = NULL;
+
+  if (ht_index_init(&ht->index, HT_INITIAL_SIZE) < 0 || ht->arena == NULL) {
+    ht_index_free(&ht->index);
+    free(ht->arena);
+    free(ht);
+    return NULL;
+  }
   return ht;
 }
 
-ht_hash_table *ht_new() { return ht_new_sized(HT_INITIAL_BASE_SIZE); }
-
 void ht_del_hash_table(ht_hash_table *ht) {
-  for (int i = 0; i < ht->size; ++i) {
-    ht_item *item = ht->items[i];
+  if (ht == NULL) {
+    return;
+  }
+
+  ht_index_free(&ht->index);
+  ht_index_free(&ht->old);
+  free(ht->arena);
+  bloom_free(ht->filter);
+  free(ht);
+}
 
-    if (item != NULL) {
-      ht_del_item(item);
+// Double hashing from one hash on a power of 2 table: the low half picks the
+// first slot, the high half the step, made odd so every slot is visited
+static inline uint32_t ht_first_slot(const ht_index *index,
+                                     const uint64_t hash) {
+  return (uint32_t)hash & (uint32_t)(index->size - 1);
+}
+
+static inline uint32_t ht_step(const uint64_t hash) {
+  return (uint32_t)(hash >> 32) | 1;
+}
+
+static inline int ht_slot_matches(const ht_hash_table *ht, const ht_slot *slot,
+                                  const uint64_t hash, const char *key,
+                                  const size_t len, const int fold) {
+  return slot->hash == hash && slot->key_len == len &&
+         slot->key != HT_DELETED &&
+         ht_key_equal(ht->arena + slot->key, key, len, fold);
+}
+
+// Slot of index holding key, or NULL
+static ht_slot *ht_find(const ht_hash_table *ht, const ht_index *index,
+                        const char *key, const size_t len,
+                        const uint64_t hash, const int fold) {
+  const uint32_t mask = (uint32_t)(index->size - 1);
+  const uint32_t step = ht_step(hash);
+  uint32_t position = ht_first_slot(index, hash);
+
+  for (int i = 0; i < index->size; i++) {
+    ht_slot *slot = &index->slots[position];
+    if (slot->key == 0) {
+      return NULL;
+    }
+    if (ht_slot_matches(ht, slot, hash, key, len, fold)) {
+      return slot;
     }
+    position = (position + step) & mask;
   }
+  return NULL;
 }
 
-static int ht_hash(const char *s, const int p, const int n) {
-  long hash = 0;
-  const int len_s = strlen(s);
+// The new index first, then what's left of the old one
+static ht_slot *ht_lookup(const ht_hash_table *ht, const char *key,
+                          const size_t len, const uint64_t hash,
+                          const int fold, ht_index **where) {
+  ht_slot *slot = ht_find(ht, &ht->index, key, len, hash, fold);
+  *where = (ht_index *)&ht->index;
+  if (slot == NULL && ht->old.slots != NULL) {
+    slot = ht_find(ht, &ht->old, key, len, hash, fold);
+    *where = (ht_index *)&ht->old;
+  }
+  return slot;
+}
+
+// Put a key known not to be in the index in the first free or deleted slot
+static void ht_place(ht_index *index, const uint64_t hash,
+                     const uint32_t offset, const uint32_t key_len) {
+  const uint32_t mask = (uint32_t)(index->size - 1);
+  const uint32_t step = ht_step(hash);
+  uint32_t position = ht_first_slot(index, hash);
 
-  for (int i = 0; i < len_s; i++) {
-    hash += (long)pow(p, len_s - (i + 1)) * s[i];
-    hash = hash % n;
+  while (index->slots[position].key != 0 &&
+         index->slots[position].key != HT_DELETED) {
+    position = (position + step) & mask;
   }
 
-  return (int)hash;
+  ht_slot *slot = &index->slots[position];
+  if (slot->key == HT_DELETED) {
+    index->deleted--;
+  }
+  slot->hash = hash;
+  slot->key = offset;
+  slot->key_len = key_len;
+  index->count++;
 }
 
-static int ht_get_hash(const char *s, const int num_buckets,
-                       const int attempt) {
-  const int hash_a = ht_hash(s, HT_PRIME_1, num_buckets);
-  const int hash_b = ht_hash(s, HT_PRIME_2, num_buckets);
-  return (hash_a + (attempt * (hash_b + 1))) % num_buckets;
+// Move the next HT_MIGRATE_SLOTS slots of the old index, if any, to the new
+// one. Moved slots are left deleted, so the old index never answers for a
+// key that was moved.
+static void ht_migrate(ht_hash_table *ht) {
+  if (ht->old.slots == NULL) {
+    return;
+  }
+
+  int end = ht->old_position + HT_MIGRATE_SLOTS;
+  if (end > ht->old.size) {
+    end = ht->old.size;
+  }
+
+  for (; ht->old_position < end; ht->old_position++) {
+    ht_slot *slot = &ht->old.slots[ht->old_position];
+    if (!ht_slot_live(slot)) {
+      continue;
+    }
+
+    ht_place(&ht->index, slot->hash, slot->key, slot->key_len);
+    slot->key = HT_DELETED;
+    ht->old.count--;
+  }
+
+  if (ht->old_position == ht->old.size) {
+    ht_index_free(&ht->old);
+  }
 }
 
-void ht_insert(ht_hash_table *ht, const char *key, const char *value) {
-  const int load = ht->count * 100 / ht->size;
+int ht_insert(ht_hash_table *ht, const char *key, const char *value) {
+  ht_migrate(ht);
+
+  // Deleted slots lengthen probes like live ones. Mostly deleted slots only
+  // need a rebuild at the same size, live ones a bigger table. Keys still in
+  // the old index count, they all end up in the new one.
+  const int live = ht->index.count + ht->old.count;
+  const int load = (live + ht->index.deleted + 1) * 100 / ht->index.size;
+  int grown = 1;
   if (load > 70) {
-    ht_resize_up(ht);
+    const int size = live * 100 / ht->index.size > 35 ? ht->index.size * 2
+                                                       : ht->index.size;
+    grown = ht_resize(ht, size) == 0;
   }
+  ht_arena_compact(ht);
 
-  ht_item *item = ht_new_item(key, value);
-  int index = ht_get_hash(item->key, ht->size, 0);
-  ht_item *cur_item = ht->items[index];
-  int i = 1;
+  const size_t key_len = strlen(key);
+  const uint64_t hash = ht_hash(key, key_len);
+  ht_index *index;
+  ht_slot *slot = ht_lookup(ht, key, key_len, hash, 0, &index);
 
-  while (cur_item != NULL) {
-    if (cur_item != &HT_DELETED_ITEM) {
-      if (strcmp(cur_item->key, key) == 0) {
-        ht_del_item(cur_item);
-        ht->items[index] = item;
-        return;
-      }
-    }
+  // An index that couldn't grow takes new keys until its last free slot
+  if (slot == NULL && !grown && ht->index.count + 1 >= ht->index.size) {
+    errno = ENOMEM;
+    return -1;
+  }
+
+  const uint32_t offset =
+      ht_arena_append(ht, key, key_len, value, strlen(value));
+  if (offset == 0) {
+    errno = ENOMEM;
+    return -1;
+  }
 
-    index = ht_get_hash(item->key, ht->size, i);
-    cur_item = ht->items[index];
-    i++;
+  // The old record stays in the arena as garbage
+  if (slot != NULL) {
+    ht->arena_garbage += ht_record_size(ht, slot);
+    slot->key = offset;
+    return 0;
   }
 
-  ht->items[index] = item;
-  ht->count++;
+  ht_place(&ht->index, hash, offset, (uint32_t)key_len);
+  if (ht->filter != NULL) {
+    bloom_add(ht->filter, hash);
+  }
+  return 0;
 }
 
 char *ht_search(ht_hash_table *ht, const char *key) {
-  int index = ht_get_hash(key, ht->size, 0);
-  ht_item *item = ht->items[index];
-  int i = 1;
-
-  while (item != NULL) {
-    if (item != &HT_DELETED_ITEM) {
-      if (strcmp(item->key, key) == 0) {
-        return item->value;
-      }
-    }
+  const size_t key_len = strlen(key);
+  const uint64_t hash = ht_hash(key, key_len);
+  if (ht_filtered_out(ht, hash)) {
+    return NULL;
+  }
 
-    index = ht_get_hash(key, ht->size, i);
-    item = ht->items[index];
-    i++;
+  ht_index *index;
+  ht_slot *slot = ht_lookup(ht, key, key_len, hash, 0, &index);
+  if (slot == NULL) {
+    return NULL;
   }
 
-  return NULL;
+  return ht->arena + slot->key + slot->key_len + 1;
 }
 
-void ht_delete(ht_hash_table *ht, const char *key) {
-  const int load = ht->count * 100 / ht->size;
-  if (load < 10) {
-    ht_resize_down(ht);
+char *ht_search_fold(ht_hash_table *ht, const char *key, size_t len) {
+  const uint64_t hash = ht_hash_fold(key, len);
+  if (ht_filtered_out(ht, hash)) {
+    return NULL;
   }
 
-  int index = ht_get_hash(key, ht->size, 0);
-  ht_item *item = ht->items[index];
-  int i = 1;
-
-  while (item != NULL) {
-    if (item != &HT_DELETED_ITEM) {
-      if (strcmp(item->key, key) == 0) {
-        ht_del_item(item);
-        ht->items[index] = &HT_DELETED_ITEM;
-      }
-    }
-
-    index = ht_get_hash(key, ht->size, i);
-    item = ht->items[index];
-    i++;
+  ht_index *index;
+  ht_slot *slot = ht_lookup(ht, key, len, hash, 1, &index);
+  if (slot == NULL) {
+    return NULL;
   }
 
-  ht->count--;
+  return ht->arena + slot->key + slot->key_len + 1;
 }
 
-static void ht_resize(ht_hash_table *ht, const int base_size) {
-  if (base_size < HT_INITIAL_BASE_SIZE) {
+void ht_delete(ht_hash_table *ht, const char *key) {
+  ht_migrate(ht);
+
+  const size_t key_len = strlen(key);
+  ht_index *index;
+  ht_slot *slot =
+      ht_lookup(ht, key, key_len, ht_hash(key, key_len), 0, &index);
+  if (slot == NULL) {
     return;
   }
-  ht_hash_table *new_ht = ht_new_sized(base_size);
-  for (int i = 0; i < ht->size; i++) {
-    ht_item *item = ht->items[i];
-    if (item != NULL && item != &HT_DELETED_ITEM) {
-      ht_insert(new_ht, item->key, item->value);
-    }
+
+  ht->arena_garbage += ht_record_size(ht, slot);
+  slot->key = HT_DELETED;
+  index->count--;
+  index->deleted++;
+
+  const int load = (ht->index.count + ht->old.count) * 100 / ht->index.size;
+  if (load < 10) {
+    ht_resize(ht, ht->index.size / 2);
   }
+}
 
-  ht->base_size = new_ht->base_size;
-  ht->count = new_ht->count;
+// Start filling a new index, the slots move over the next operations. Only
+// one resize at a time: one due before the last one is done finishes it.
+static int ht_resize(ht_hash_table *ht, const int size) {
+  if (size < HT_INITIAL_SIZE) {
+    return 0;
+  }
 
-  const int tmp_size = ht->size;
-  ht->size = new_ht->size;
-  new_ht->size = tmp_size;
+  while (ht->old.slots != NULL) {
+    ht_migrate(ht);
+  }
 
-  ht_item **tmp_items = ht->items;
-  ht->items = new_ht->items;
-  new_ht->items = tmp_items;
+  ht_index index;
+  if (ht_index_init(&index, size) < 0) {
+    return -1;
+  }
 
-  ht_del_hash_table(new_ht);
+  ht->old = ht->index;
+  ht->index = index;
+  ht->old_position = 0;
+  return 0;
 }
 
-static void ht_resize_up(ht_hash_table *ht) {
-  const int new_size = ht->base_size * 2;
-  ht_resize(ht, new_size);
-}
+const char *ht_backend() { return "open addressing"; }
+
+#endif // HT_SWISS
+
+// Both backends keep the full hash in every slot, the filter is built from
+// them without reading a key
+int ht_filter_build(ht_hash_table *ht) {
+  bloom_filter *filter = bloom_new((size_t)(ht->index.count + ht->old.count));
+  if (filter == NULL) {
+    return -1;
+  }
+
+  const ht_index *indexes[] = {&ht->index, &ht->old};
+  for (int n = 0; n < 2; n++) {
+    for (int i = 0; indexes[n]->slots != NULL && i < indexes[n]->size; i++) {
+      if (ht_slot_live(&indexes[n]->slots[i])) {
+        bloom_add(filter, indexes[n]->slots[i].hash);
+      }
+    }
+  }
 
-static void ht_resize_down(ht_hash_table *ht) {
-  const int new_size = ht->base_size / 2;
-  ht_resize(ht, new_size);
+  bloom_free(ht->filter);
+  ht->filter = filter;
+  return 0;
 }
@@ -1,24 +1,111 @@
 #ifndef HASHTABLE_H
 #define HASHTABLE_H
 
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../bloom/bloom.h"
+
+// Two backends with the same API, picked at build time: define HT_SWISS
+// (gcc -DHT_SWISS) for the Swiss table, otherwise plain open addressing.
+//
+// Both keep their keys in one arena, every key stored there as
+// "key\0value\0", and index it with one flat array of slots. A slot keeps
+// the full hash of its key and where the key is in the arena, so a resize
+// only moves slots. Strings of deleted and overwritten keys stay in the arena
+// as garbage until it's half of it, then the live ones are compacted.
 typedef struct {
-  char *key;
-  char *value;
-} ht_item;
+  uint64_t hash;
+  uint32_t key;     // arena offset, 0 when empty, HT_DELETED when deleted
+  uint32_t key_len; // without the NUL
+} ht_slot;
+
+#ifdef HT_SWISS
 
+#define HT_GROUP_SIZE 16
+
+// Swiss table: one control byte per slot, either empty, deleted or 7 bits of
+// the hash of its key. A probe loads a group of 16 control bytes and matches
+// them all at once (SSE2, or 8 at a time with plain 64-bit words elsewhere),
+// so it reads the slots only for candidates and stops at the first group
+// with an empty byte.
 typedef struct {
-  int base_size;
-  int size;
+  int size; // power of 2, at least HT_GROUP_SIZE
   int count;
-  ht_item **items;
+  int deleted;
+  uint8_t *ctrl; // size bytes, then the first group again for wrap around
+  ht_slot *slots;
+} ht_index;
+
+#else
+
+// Open addressing with double hashing: a probe that misses reads only the
+// slot array, a hit reads one more line of the arena.
+typedef struct {
+  int size; // power of 2
+  int count;
+  int deleted;
+  ht_slot *slots;
+} ht_index;
+
+#endif // HT_SWISS
+
+// A resize doesn't rehash the whole table at once: the new index is filled
+// by every insert and delete moving a few slots of the old one, and lookups
+// read both until the old one is empty. No operation pays for the whole
+// table.
+typedef struct {
+  ht_index index;
+  ht_index old;     // slots NULL unless a resize is in progress
+  int old_position; // old slots before it were already moved
+
+  char *arena;
+  size_t arena_len;
+  size_t arena_capacity;
+  size_t arena_garbage; // bytes no slot refers to anymore
+
+  bloom_filter *filter; // NULL until ht_filter_build
 } ht_hash_table;
 
 ht_hash_table *ht_new();
 
 void ht_del_hash_table(ht_hash_table *ht);
 
-void ht_insert(ht_hash_table *ht, const char *key, const char *value);
+// Values returned by ht_search point into the arena: they stay valid until
+// the next insert on the same table. ht_insert returns -1 when out of memory,
+// the table is left as it was.
+int ht_insert(ht_hash_table *ht, const char *key, const char *value);
 char *ht_search(ht_hash_table *ht, const char *key);
 void ht_delete(ht_hash_table *h, const char *key);
 
+// Case-insensitive lookups
+//
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+// Keys inserted folded (ASCII letters lowercase, every other byte as is) can
+// be searched with a key in any case: the key is folded while it's hashed
+// and compared, never copied nor changed, and needs no NUL after its len
+// bytes.
+static inline char ht_fold_char(const char c) {
+  return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+// Copy src folded into dst, NUL included
+static inline void ht_fold_key(char *dst, const char *src) {
+  while ((*dst++ = ht_fold_char(*src++)) != '\0') {
+  }
+}
+
+char *ht_search_fold(ht_hash_table *ht, const char *key, size_t len);
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+// A Bloom filter of the keys (bloom/bloom.h), for tables mostly searched for
+// keys they don't have: a search it rules out reads one cache line, not the
+// slots. Built once the table is filled, keys inserted after are added to
+// it, deleted ones stay in it as false positives. Returns -1 when out of
+// memory, the table works without it.
+int ht_filter_build(ht_hash_table *ht);
+
+const char *ht_backend();
+
 #endif // HASHTABLE_H
@@ -0,0 +1,279 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../rcu/rcu.h"
+#include "hash_table_concurrent.h"
+#include "hash_table_internal.h"
+
+#define CHT_INITIAL_SIZE 64
+// Unlinked entries freed together, one grace period for all of them
+#define CHT_RETIRE_BATCH 64
+
+// Left in the slot of a deleted key, so probes go on past it
+static cht_entry cht_tombstone;
+
+static cht_slots *cht_slots_new(const uint32_t size) {
+  cht_slots *s =
+      calloc(1, sizeof(cht_slots) + size * sizeof(_Atomic(cht_entry *)));
+  if (s != NULL) {
+    s->mask = size - 1;
+  }
+  return s;
+}
+
+cht_hash_table *cht_new() {
+  cht_hash_table *t = malloc(sizeof(cht_hash_table));
+  if (t == NULL) {
+    return NULL;
+  }
+
+  cht_slots *slots = cht_slots_new(CHT_INITIAL_SIZE);
+  if (slots == NULL) {
+    free(t);
+    return NULL;
+  }
+
+  atomic_init(&t->slots, slots);
+  atomic_init(&t->live, 0);
+  pthread_mutex_init(&t->writer, NULL);
+  t->count = 0;
+  t->deleted = 0;
+  t->retired = NULL;
+  t->retired_count = 0;
+  t->retired_capacity = 0;
+  return t;
+}
+
+void cht_del_hash_table(cht_hash_table *t) {
+  if (t == NULL) {
+    return;
+  }
+
+  cht_slots *s = atomic_load(&t->slots);
+  for (uint32_t i = 0; i <= s->mask; i++) {
+    cht_entry *e = atomic_load_explicit(&s->slots[i], memory_order_relaxed);
+    if (e != NULL && e != &cht_tombstone) {
+      free(e);
+    }
+  }
+  free(s);
+
+  for (int i = 0; i < t->retired_count; i++) {
+    free(t->retired[i]);
+  }
+  free(t->retired);
+  pthread_mutex_destroy(&t->writer);
+  free(t);
+}
+
+static inline int cht_entry_matches(const cht_entry *e, const uint64_t hash,
+                                    const char *key, const size_t len,
+                                    const int fold) {
+  return e->hash == hash && e->key_len == len &&
+         ht_key_equal(e->data, key, len, fold);
+}
+
+static const char *cht_lookup(cht_hash_table *t, const char *key,
+                              const size_t len, const uint64_t hash,
+                              const int fold) {
+  const cht_slots *s = atomic_load_explicit(&t->slots, memory_order_acquire);
+
+  uint32_t position = (uint32_t)hash;
+  for (uint32_t n = 0; n <= s->mask; n++, position++) {
+    const cht_entry *e = atomic_load_explicit(&s->slots[position & s->mask],
+                                              memory_order_acquire);
+    if (e == NULL) {
+      return NULL;
+    }
+    if (e != &cht_tombstone && cht_entry_matches(e, hash, key, len, fold)) {
+      return e->data + e->key_len + 1;
+    }
+  }
+  return NULL;
+}
+
+// Most tables searched on every word are empty (corrections nobody sent):
+// those return before the key is hashed. A key inserted while it's searched
+// is found or not, as with a non-empty table.
+static inline int cht_empty(cht_hash_table *t) {
+  return atomic_load_explicit(&t->live, memory_order_relaxed) == 0;
+}
+
+const char *cht_search(cht_hash_table *t, const char *key) {
+  if (cht_empty(t)) {
+    return NULL;
+  }
+  const size_t len = strlen(key);
+  return cht_lookup(t, key, len, ht_hash(key, len), 0);
+}
+
+const char *cht_search_fold(cht_hash_table *t, const char *key, size_t len) {
+  if (cht_empty(t)) {
+    return NULL;
+  }
+  return cht_lookup(t, key, len, ht_hash_fold(key, len), 1);
+}
+
+// Writers
+//
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+// Everything below runs with the writer mutex held, so the writer's own
+// loads can be relaxed: only its stores have to be ordered for the readers.
+
+static void cht_reclaim(cht_hash_table *t) {
+  rcu_synchronize();
+  for (int i = 0; i < t->retired_count; i++) {
+    free(t->retired[i]);
+  }
+  t->retired_count = 0;
+}
+
+// Free p once no reader can hold it anymore
+static void cht_retire(cht_hash_table *t, void *p) {
+  if (t->retired_count == t->retired_capacity) {
+    int capacity = t->retired_capacity > 0 ? t->retired_capacity * 2 : 16;
+    void **retired = realloc(t->retired, capacity * sizeof(void *));
+    if (retired == NULL) {
+      rcu_synchronize();
+      free(p);
+      return;
+    }
+    t->retired = retired;
+    t->retired_capacity = capacity;
+  }
+
+  t->retired[t->retired_count++] = p;
+  if (t->retired_count >= CHT_RETIRE_BATCH) {
+    cht_reclaim(t);
+  }
+}
+
+// Position of key, or -1 with the position it would take in place
+static long cht_find(const cht_slots *s, const uint64_t hash,
+                     const char *key, const size_t len, uint32_t *place) {
+  long tombstone = -1;
+  uint32_t position = (uint32_t)hash;
+
+  for (uint32_t n = 0; n <= s->mask; n++, position++) {
+    const uint32_t i = position & s->mask;
+    const cht_entry *e =
+        atomic_load_explicit(&s->slots[i], memory_order_relaxed);
+    if (e == NULL) {
+      *place = tombstone >= 0 ? (uint32_t)tombstone : i;
+      return -1;
+    }
+    if (e == &cht_tombstone) {
+      if (tombstone < 0) {
+        tombstone = i;
+      }
+    } else if (cht_entry_matches(e, hash, key, len, 0)) {
+      return i;
+    }
+  }
+
+  // Full, only when growing failed
+  *place = tombstone >= 0 ? (uint32_t)tombstone : UINT32_MAX;
+  return -1;
+}
+
+// Copy the live entries into a new slot array and publish it whole: readers
+// see either array, both hold the same entries
+static void cht_resize(cht_hash_table *t, const uint32_t size) {
+  cht_slots *old = atomic_load_explicit(&t->slots, memory_order_relaxed);
+  cht_slots *s = cht_slots_new(size);
+  if (s == NULL) {
+    return;
+  }
+
+  for (uint32_t i = 0; i <= old->mask; i++) {
+    cht_entry *e = atomic_load_explicit(&old->slots[i], memory_order_relaxed);
+    if (e == NULL || e == &cht_tombstone) {
+      continue;
+    }
+
+    uint32_t position = (uint32_t)e->hash;
+    while (atomic_load_explicit(&s->slots[position & s->mask],
+                                memory_order_relaxed) != NULL) {
+      position++;
+    }
+    atomic_store_explicit(&s->slots[position & s->mask], e,
+                          memory_order_relaxed);
+  }
+
+  atomic_store_explicit(&t->slots, s, memory_order_release);
+  t->deleted = 0;
+  cht_retire(t, old);
+  cht_reclaim(t);
+}
+
+void cht_insert(cht_hash_table *t, const char *key, const char *value) {
+  const size_t key_len = strlen(key);
+  const size_t value_len = strlen(value);
+  cht_entry *entry = malloc(sizeof(cht_entry) + key_len + value_len + 2);
+  if (entry == NULL) {
+    return;
+  }
+
+  entry->hash = ht_hash(key, key_len);
+  entry->key_len = (uint32_t)key_len;
+  memcpy(entry->data, key, key_len + 1);
+  memcpy(entry->data + key_len + 1, value, value_len + 1);
+
+  pthread_mutex_lock(&t->writer);
+
+  // Like the other tables: mostly deleted slots only need a rebuild at the
+  // same size, live ones a bigger array
+  cht_slots *s = atomic_load_explicit(&t->slots, memory_order_relaxed);
+  const uint64_t size = (uint64_t)s->mask + 1;
+  if ((uint64_t)(t->count + t->deleted + 1) * 10 > size * 7) {
+    cht_resize(t, (uint64_t)t->count * 20 > size * 7 ? size * 2 : size);
+    s = atomic_load_explicit(&t->slots, memory_order_relaxed);
+  }
+
+  uint32_t place;
+  const long found = cht_find(s, entry->hash, key, key_len, &place);
+  if (found >= 0) {
+    cht_entry *old =
+        atomic_load_explicit(&s->slots[found], memory_order_relaxed);
+    atomic_store_explicit(&s->slots[found], entry, memory_order_release);
+    cht_retire(t, old);
+  } else if (place == UINT32_MAX) {
+    free(entry);
+  } else {
+    if (atomic_load_explicit(&s->slots[place], memory_order_relaxed) ==
+        &cht_tombstone) {
+      t->deleted--;
+    }
+    atomic_store_explicit(&s->slots[place], entry, memory_order_release);
+    t->count++;
+    atomic_store_explicit(&t->live, t->count, memory_order_relaxed);
+  }
+
+  pthread_mutex_unlock(&t->writer);
+}
+
+void cht_delete(cht_hash_table *t, const char *key) {
+  const size_t key_len = strlen(key);
+  const uint64_t hash = ht_hash(key, key_len);
+
+  pthread_mutex_lock(&t->writer);
+
+  cht_slots *s = atomic_load_explicit(&t->slots, memory_order_relaxed);
+  uint32_t place;
+  const long found = cht_find(s, hash, key, key_len, &place);
+  if (found >= 0) {
+    cht_entry *old =
+        atomic_load_explicit(&s->slots[found], memory_order_relaxed);
+    atomic_store_explicit(&s->slots[found], &cht_tombstone,
+                          memory_order_release);
+    t->count--;
+    t->deleted++;
+    atomic_store_explicit(&t->live, t->count, memory_order_relaxed);
+    cht_retire(t, old);
+  }
+
+  pthread_mutex_unlock(&t->writer);
+}
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
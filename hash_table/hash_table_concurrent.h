@@ -0,0 +1,58 @@
+#ifndef HASHTABLECONCURRENT_H
+#define HASHTABLECONCURRENT_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Hash table for data read by many threads while a few change it: readers
+// take no lock and write nothing shared, writers are serialized by a mutex.
+//
+// Every key lives in its own immutable entry, slots are atomic pointers to
+// entries. A writer builds a whole entry before publishing it with one
+// pointer store, and replaces it (new value, delete, resize into a new slot
+// array) the same way. What it unlinks is freed only after an RCU grace
+// period, so readers must search between rcu_read_lock and rcu_read_unlock
+// (rcu/rcu.h) and use the value before leaving.
+
+typedef struct {
+  uint64_t hash;
+  uint32_t key_len;
+  char data[]; // "key\0value\0"
+} cht_entry;
+
+// Open addressing with linear probing, a power of 2 of slots
+typedef struct {
+  uint32_t mask;
+  _Atomic(cht_entry *) slots[];
+} cht_slots;
+
+typedef struct {
+  _Atomic(cht_slots *) slots;
+  atomic_int live; // count, for readers: an empty table is never probed
+
+  // Writers only
+  pthread_mutex_t writer;
+  int count;
+  int deleted;
+  void **retired; // entries and slot arrays waiting for a grace period
+  int retired_count;
+  int retired_capacity;
+} cht_hash_table;
+
+cht_hash_table *cht_new();
+
+// No reader may be left when it's called
+void cht_del_hash_table(cht_hash_table *t);
+
+void cht_insert(cht_hash_table *t, const char *key, const char *value);
+void cht_delete(cht_hash_table *t, const char *key);
+
+// Inside an RCU read section only, the value is freed after it
+const char *cht_search(cht_hash_table *t, const char *key);
+
+// Same, for keys inserted folded: see ht_search_fold (hash_table.h)
+const char *cht_search_fold(cht_hash_table *t, const char *key, size_t len);
+
+#endif // HASHTABLECONCURRENT_H
@@ -0,0 +1,214 @@
+#ifndef HASHTABLEINTERNAL_H
+#define HASHTABLEINTERNAL_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash_table.h"
+
+// Shared by the backends: the key hash and the string arena
+
+#define HT_INITIAL_ARENA (16 * 1024)
+#define HT_DELETED UINT32_MAX
+
+// Slots of the old index moved by every insert and delete during a resize.
+// Enough to empty it before the new index is due to resize in turn. Set at
+// build time, bench/rehash.c moves them all at once to compare.
+#ifndef HT_MIGRATE_SLOTS
+#define HT_MIGRATE_SLOTS 32
+#endif
+
+// wyhash constants: odd, with well spread bits
+#define HT_SECRET_0 0xa0761d6478bd642fULL
+#define HT_SECRET_1 0xe7037ed1a0b428dbULL
+#define HT_SECRET_2 0x8ebc6af09c88c6e3ULL
+
+// 64x64 -> 128 bit multiply folded back to 64 bits, the mixing step of
+// wyhash
+static inline uint64_t ht_mix(uint64_t a, uint64_t b) {
+  __uint128_t r = (__uint128_t)a * b;
+  return (uint64_t)r ^ (uint64_t)(r >> 64);
+}
+
+static inline uint64_t ht_read64(const unsigned char *p) {
+  uint64_t v;
+  memcpy(&v, p, 8);
+  return v;
+}
+
+// Up to 8 bytes, zero padded
+static inline uint64_t ht_read_tail(const unsigned char *p, size_t len) {
+  uint64_t v = 0;
+  memcpy(&v, p, len);
+  return v;
+}
+
+// ASCII 'A' to 'Z' made lowercase in all 8 bytes of a word at once. Adding
+// to the low 7 bits of a byte sets its high bit when they're at least 'A'
+// (+0x3f) or past 'Z' (+0x25), without a carry into the next byte; bytes
+// with the high bit already set are no ASCII and stay as they are.
+static inline uint64_t ht_fold64(const uint64_t v) {
+  const uint64_t low = v & 0x7f7f7f7f7f7f7f7fULL;
+  const uint64_t at_least_a = low + 0x3f3f3f3f3f3f3f3fULL;
+  const uint64_t past_z = low + 0x2525252525252525ULL;
+  const uint64_t upper = at_least_a & ~past_z & ~v & 0x8080808080808080ULL;
+  return v | (upper >> 2); // 0x20 in every uppercase letter
+}
+
+// wyhash style: 16 bytes per multiply instead of a pow and a modulo per
+// character. Vocabulary words fit in one or two rounds. With fold every
+// word read is folded first, so the hash is the one of the folded key.
+static inline uint64_t ht_hash_words(const char *s, size_t len,
+                                     const int fold) {
+  const unsigned char *p = (const unsigned char *)s;
+  uint64_t seed = HT_SECRET_0 ^ ht_mix(len ^ HT_SECRET_1, HT_SECRET_0);
+  size_t left = len;
+
+  while (left > 16) {
+    uint64_t a = ht_read64(p), b = ht_read64(p + 8);
+    if (fold) {
+      a = ht_fold64(a);
+      b = ht_fold64(b);
+    }
+    seed = ht_mix(a ^ HT_SECRET_1, b ^ seed);
+    p += 16;
+    left -= 16;
+  }
+
+  uint64_t a, b;
+  if (left > 8) {
+    a = ht_read64(p);
+    b = ht_read_tail(p + 8, left - 8);
+  } else {
+    a = ht_read_tail(p, left);
+    b = 0;
+  }
+  if (fold) {
+    a = ht_fold64(a);
+    b = ht_fold64(b);
+  }
+
+  uint64_t mixed = ht_mix(a ^ HT_SECRET_1, b ^ seed);
+  return ht_mix(mixed ^ HT_SECRET_2, len ^ HT_SECRET_1);
+}
+
+static inline uint64_t ht_hash(const char *s, size_t len) {
+  return ht_hash_words(s, len, 0);
+}
+
+// Same as ht_hash of the folded key
+static inline uint64_t ht_hash_fold(const char *s, size_t len) {
+  return ht_hash_words(s, len, 1);
+}
+
+// Key of len bytes equal to a stored one, folded first when fold is set:
+// the stored key then has to be folded already
+static inline int ht_key_equal(const char *stored, const char *key,
+                               size_t len, const int fold) {
+  if (!fold) {
+    return memcmp(stored, key, len) == 0;
+  }
+
+  const unsigned char *s = (const unsigned char *)stored;
+  const unsigned char *k = (const unsigned char *)key;
+  for (; len >= 8; len -= 8, s += 8, k += 8) {
+    if (ht_read64(s) != ht_fold64(ht_read64(k))) {
+      return 0;
+    }
+  }
+  return ht_read_tail(s, len) == ht_fold64(ht_read_tail(k, len));
+}
+
+// Surely not in the table, with the hash of the key
+static inline int ht_filtered_out(const ht_hash_table *ht,
+                                  const uint64_t hash) {
+  return ht->filter != NULL && !bloom_may_contain(ht->filter, hash);
+}
+
+static inline int ht_slot_live(const ht_slot *slot) {
+  return slot->key != 0 && slot->key != HT_DELETED;
+}
+
+// Bytes of the "key\0value\0" record of a slot
+static inline size_t ht_record_size(const ht_hash_table *ht,
+                                    const ht_slot *slot) {
+  const char *value = ht->arena + slot->key + slot->key_len + 1;
+  return slot->key_len + 1 + strlen(value) + 1;
+}
+
+// Copy "key\0value\0" at the end of the arena, returns its offset or 0
+static inline uint32_t ht_arena_append(ht_hash_table *ht, const char *key,
+                                const size_t key_len, const char *value,
+                                const size_t value_len) {
+  const size_t size = key_len + 1 + value_len + 1;
+  if (ht->arena_len + size > HT_DELETED) {
+    return 0;
+  }
+
+  if (ht->arena_len + size > ht->arena_capacity) {
+    size_t capacity = ht->arena_capacity * 2;
+    while (capacity < ht->arena_len + size) {
+      capacity *= 2;
+    }
+
+    char *arena = realloc(ht->arena, capacity);
+    if (arena == NULL) {
+      return 0;
+    }
+    ht->arena = arena;
+    ht->arena_capacity = capacity;
+  }
+
+  const uint32_t offset = (uint32_t)ht->arena_len;
+  memcpy(ht->arena + offset, key, key_len + 1);
+  memcpy(ht->arena + offset + key_len + 1, value, value_len + 1);
+  ht->arena_len += size;
+  return offset;
+}
+
+// Copy the records of the live slots into a new arena once most of the old
+// one is garbage. Costs as many bytes as there are live ones, which at least
+// as many garbage bytes paid for, and the arena shrinks back if the table
+// did.
+static inline void ht_arena_compact(ht_hash_table *ht) {
+  if (ht->arena_garbage * 2 <= ht->arena_len) {
+    return;
+  }
+
+  const size_t live = ht->arena_len - ht->arena_garbage;
+  size_t capacity = HT_INITIAL_ARENA;
+  while (capacity < live) {
+    capacity *= 2;
+  }
+
+  char *arena = malloc(capacity);
+  if (arena == NULL) {
+    return;
+  }
+
+  // Offset 0 is never a record
+  size_t len = 1;
+  ht_index *indexes[] = {&ht->index, &ht->old};
+  for (int n = 0; n < 2; n++) {
+    for (int i = 0; indexes[n]->slots != NULL && i < indexes[n]->size; i++) {
+      ht_slot *slot = &indexes[n]->slots[i];
+      if (!ht_slot_live(slot)) {
+        continue;
+      }
+
+      const size_t size = ht_record_size(ht, slot);
+      memcpy(arena + len, ht->arena + slot->key, size);
+      slot->key = (uint32_t)len;
+      len += size;
+    }
+  }
+
+  free(ht->arena);
+  ht->arena = arena;
+  ht->arena_len = len;
+  ht->arena_capacity = capacity;
+  ht->arena_garbage = 0;
+}
+
+#endif // HASHTABLEINTERNAL_H
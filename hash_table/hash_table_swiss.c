@@ -0,0 +1,399 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash_table.h"
+#include "hash_table_internal.h"
+
+#ifdef HT_SWISS
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define HT_INITIAL_SIZE 1024
+
+// Control bytes: full slots hold the top 7 bits of their hash (h2), so the
+// high bit alone tells free from full
+#define HT_CTRL_EMPTY 0x80
+#define HT_CTRL_DELETED 0xfe
+
+static int ht_resize(ht_hash_table *ht, const int size);
+
+// Groups
+//
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+// Every match returns one bit per slot of the group, bit i for slot pos + i
+#if defined(__SSE2__)
+
+static inline uint32_t ht_group_match(const uint8_t *ctrl, const uint8_t h2) {
+  __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+  return (uint32_t)_mm_movemask_epi8(
+      _mm_cmpeq_epi8(group, _mm_set1_epi8((char)h2)));
+}
+
+static inline uint32_t ht_group_match_empty(const uint8_t *ctrl) {
+  return ht_group_match(ctrl, HT_CTRL_EMPTY);
+}
+
+static inline uint32_t ht_group_match_free(const uint8_t *ctrl) {
+  __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+  return (uint32_t)_mm_movemask_epi8(group);
+}
+
+#define HT_GROUP_ENGINE "sse2"
+
+#else
+
+#define HT_LSBS 0x0101010101010101ULL
+#define HT_MSBS 0x8080808080808080ULL
+
+// The high bit of every byte of m, packed into the low 8 bits
+static inline uint32_t ht_word_bits(uint64_t m) {
+  return (uint32_t)(((m >> 7) * 0x0102040810204080ULL) >> 56);
+}
+
+static inline uint64_t ht_load_word(const uint8_t *p) {
+  uint64_t w;
+  memcpy(&w, p, 8);
+  return w;
+}
+
+// Bytes equal to h2 have their high bit set in the result. A byte right after
+// a match can be a false positive, the slot comparison weeds it out.
+static inline uint64_t ht_word_match(const uint64_t w, const uint8_t h2) {
+  const uint64_t x = w ^ (HT_LSBS * h2);
+  return (x - HT_LSBS) & ~x & HT_MSBS;
+}
+
+// Exact: EMPTY is the only control byte with bit 7 set and bit 1 clear
+static inline uint64_t ht_word_match_empty(const uint64_t w) {
+  return w & ~(w << 6) & HT_MSBS;
+}
+
+static inline uint32_t ht_group_match(const uint8_t *ctrl, const uint8_t h2) {
+  return ht_word_bits(ht_word_match(ht_load_word(ctrl), h2)) |
+         ht_word_bits(ht_word_match(ht_load_word(ctrl + 8), h2)) << 8;
+}
+
+static inline uint32_t ht_group_match_empty(const uint8_t *ctrl) {
+  return ht_word_bits(ht_word_match_empty(ht_load_word(ctrl))) |
+         ht_word_bits(ht_word_match_empty(ht_load_word(ctrl + 8))) << 8;
+}
+
+static inline uint32_t ht_group_match_free(const uint8_t *ctrl) {
+  return ht_word_bits(ht_load_word(ctrl) & HT_MSBS) |
+         ht_word_bits(ht_load_word(ctrl + 8) & HT_MSBS) << 8;
+}
+
+#define HT_GROUP_ENGINE "64-bit words"
+
+#endif // __SSE2__
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+static inline uint8_t ht_h2(const uint64_t hash) {
+  return (uint8_t)(hash >> 57);
+}
+
+// The first group is mirrored after the last slot, so a group load starting
+// anywhere in the index never wraps
+static inline void ht_set_ctrl(ht_index *index, const uint32_t position,
+                               const uint8_t value) {
+  index->ctrl[position] = value;
+  if (position < HT_GROUP_SIZE) {
+    index->ctrl[index->size + position] = value;
+  }
+}
+
+static int ht_index_init(ht_index *index, const int size) {
+  index->size = size;
+  index->count = 0;
+  index->deleted = 0;
+  index->ctrl = malloc((size_t)size + HT_GROUP_SIZE);
+  index->slots = calloc((size_t)size, sizeof(ht_slot));
+  if (index->ctrl == NULL || index->slots == NULL) {
+    free(index->ctrl);
+    free(index->slots);
+    index->ctrl = NULL;
+    index->slots = NULL;
+    return -1;
+  }
+
+  memset(index->ctrl, HT_CTRL_EMPTY, (size_t)size + HT_GROUP_SIZE);
+  return 0;
+}
+
+static void ht_index_free(ht_index *index) {
+  free(index->ctrl);
+  free(index->slots);
+  index->ctrl = NULL;
+  index->slots = NULL;
+}
+
+ht_hash_table *ht_new() {
+  ht_hash_table *ht = malloc(sizeof(ht_hash_table));
+  if (ht == NULL) {
+    return NULL;
+  }
+
+  memset(&ht->old, 0, sizeof(ht->old));
+  ht->old_position = 0;
+
+  // Offset 0 is never a key, like in the open addressing backend
+  ht->arena_capacity = HT_INITIAL_ARENA;
+  ht->arena = malloc(ht->arena_capacity);
+  ht->arena_len = 1;
+  ht->arena_garbage = 0;
+  ht->filter = NULL;
+
+  if (ht_index_init(&ht->index, HT_INITIAL_SIZE) < 0 || ht->arena == NULL) {
+    ht_index_free(&ht->index);
+    free(ht->arena);
+    free(ht);
+    return NULL;
+  }
+  return ht;
+}
+
+void ht_del_hash_table(ht_hash_table *ht) {
+  if (ht == NULL) {
+    return;
+  }
+
+  ht_index_free(&ht->index);
+  ht_index_free(&ht->old);
+  free(ht->arena);
+  bloom_free(ht->filter);
+  free(ht);
+}
+
+// Groups are visited at triangular offsets (16, 32, 48... slots further each
+// time), which covers a power of 2 index
+static ht_slot *ht_find(const ht_hash_table *ht, const ht_index *index,
+                        const char *key, const size_t len,
+                        const uint64_t hash, const int fold) {
+  const uint32_t mask = (uint32_t)(index->size - 1);
+  const uint8_t h2 = ht_h2(hash);
+  uint32_t pos = (uint32_t)hash & mask;
+
+  for (uint32_t step = HT_GROUP_SIZE; step <= mask + HT_GROUP_SIZE;
+       step += HT_GROUP_SIZE) {
+    const uint8_t *group = index->ctrl + pos;
+
+    for (uint32_t m = ht_group_match(group, h2); m != 0; m &= m - 1) {
+      ht_slot *slot = &index->slots[(pos + __builtin_ctz(m)) & mask];
+      if (slot->hash == hash && slot->key_len == len &&
+          ht_key_equal(ht->arena + slot->key, key, len, fold)) {
+        return slot;
+      }
+    }
+
+    // Inserts fill the first free slot of the sequence, so a key can't be
+    // past a group that still has an empty one
+    if (ht_group_match_empty(group) != 0) {
+      return NULL;
+    }
+    pos = (pos + step) & mask;
+  }
+  return NULL;
+}
+
+// The new index first, then what's left of the old one
+static ht_slot *ht_lookup(const ht_hash_table *ht, const char *key,
+                          const size_t len, const uint64_t hash,
+                          const int fold, ht_index **where) {
+  ht_slot *slot = ht_find(ht, &ht->index, key, len, hash, fold);
+  *where = (ht_index *)&ht->index;
+  if (slot == NULL && ht->old.slots != NULL) {
+    slot = ht_find(ht, &ht->old, key, len, hash, fold);
+    *where = (ht_index *)&ht->old;
+  }
+  return slot;
+}
+
+// Put a key known not to be in the index in the first free or deleted slot
+static void ht_place(ht_index *index, const uint64_t hash,
+                     const uint32_t offset, const uint32_t key_len) {
+  const uint32_t mask = (uint32_t)(index->size - 1);
+  uint32_t pos = (uint32_t)hash & mask;
+  uint32_t step = HT_GROUP_SIZE;
+  uint32_t m;
+
+  while ((m = ht_group_match_free(index->ctrl + pos)) == 0) {
+    pos = (pos + step) & mask;
+    step += HT_GROUP_SIZE;
+  }
+
+  const uint32_t position = (pos + __builtin_ctz(m)) & mask;
+  if (index->ctrl[position] == HT_CTRL_DELETED) {
+    index->deleted--;
+  }
+  ht_set_ctrl(index, position, ht_h2(hash));
+
+  ht_slot *slot = &index->slots[position];
+  slot->hash = hash;
+  slot->key = offset;
+  slot->key_len = key_len;
+  index->count++;
+}
+
+// Deleted slots are marked in the slot too, for the arena compaction
+static void ht_slot_delete(ht_index *index, ht_slot *slot) {
+  ht_set_ctrl(index, (uint32_t)(slot - index->slots), HT_CTRL_DELETED);
+  slot->key = HT_DELETED;
+  index->count--;
+  index->deleted++;
+}
+
+// Move the next HT_MIGRATE_SLOTS slots of the old index, if any, to the new
+// one. Moved slots are left deleted, so the old index never answers for a
+// key that was moved.
+static void ht_migrate(ht_hash_table *ht) {
+  if (ht->old.slots == NULL) {
+    return;
+  }
+
+  int end = ht->old_position + HT_MIGRATE_SLOTS;
+  if (end > ht->old.size) {
+    end = ht->old.size;
+  }
+
+  for (; ht->old_position < end; ht->old_position++) {
+    if (ht->old.ctrl[ht->old_position] & HT_CTRL_EMPTY) {
+      continue;
+    }
+
+    ht_slot *slot = &ht->old.slots[ht->old_position];
+    ht_place(&ht->index, slot->hash, slot->key, slot->key_len);
+    ht_slot_delete(&ht->old, slot);
+  }
+
+  if (ht->old_position == ht->old.size) {
+    ht_index_free(&ht->old);
+  }
+}
+
+int ht_insert(ht_hash_table *ht, const char *key, const char *value) {
+  ht_migrate(ht);
+
+  // Groups can be fuller than open addressing slots, 7/8 before growing.
+  // Keys still in the old index count, they all end up in the new one.
+  const int live = ht->index.count + ht->old.count;
+  int grown = 1;
+  if ((live + ht->index.deleted + 1) * 8 > ht->index.size * 7) {
+    const int size = live * 100 / ht->index.size > 40 ? ht->index.size * 2
+                                                       : ht->index.size;
+    grown = ht_resize(ht, size) == 0;
+  }
+  ht_arena_compact(ht);
+
+  const size_t key_len = strlen(key);
+  const uint64_t hash = ht_hash(key, key_len);
+  ht_index *index;
+  ht_slot *slot = ht_lookup(ht, key, key_len, hash, 0, &index);
+
+  // An index that couldn't grow takes new keys until its last free slot
+  if (slot == NULL && !grown && ht->index.count + 1 >= ht->index.size) {
+    errno = ENOMEM;
+    return -1;
+  }
+
+  const uint32_t offset =
+      ht_arena_append(ht, key, key_len, value, strlen(value));
+  if (offset == 0) {
+    errno = ENOMEM;
+    return -1;
+  }
+
+  // The old record stays in the arena as garbage
+  if (slot != NULL) {
+    ht->arena_garbage += ht_record_size(ht, slot);
+    slot->key = offset;
+    return 0;
+  }
+
+  ht_place(&ht->index, hash, offset, (uint32_t)key_len);
+  if (ht->filter != NULL) {
+    bloom_add(ht->filter, hash);
+  }
+  return 0;
+}
+
+char *ht_search(ht_hash_table *ht, const char *key) {
+  const size_t key_len = strlen(key);
+  const uint64_t hash = ht_hash(key, key_len);
+  if (ht_filtered_out(ht, hash)) {
+    return NULL;
+  }
+
+  ht_index *index;
+  ht_slot *slot = ht_lookup(ht, key, key_len, hash, 0, &index);
+  if (slot == NULL) {
+    return NULL;
+  }
+
+  return ht->arena + slot->key + slot->key_len + 1;
+}
+
+char *ht_search_fold(ht_hash_table *ht, const char *key, size_t len) {
+  const uint64_t hash = ht_hash_fold(key, len);
+  if (ht_filtered_out(ht, hash)) {
+    return NULL;
+  }
+
+  ht_index *index;
+  ht_slot *slot = ht_lookup(ht, key, len, hash, 1, &index);
+  if (slot == NULL) {
+    return NULL;
+  }
+
+  return ht->arena + slot->key + slot->key_len + 1;
+}
+
+void ht_delete(ht_hash_table *ht, const char *key) {
+  ht_migrate(ht);
+
+  const size_t key_len = strlen(key);
+  ht_index *index;
+  ht_slot *slot =
+      ht_lookup(ht, key, key_len, ht_hash(key, key_len), 0, &index);
+  if (slot == NULL) {
+    return;
+  }
+
+  ht->arena_garbage += ht_record_size(ht, slot);
+  ht_slot_delete(index, slot);
+
+  const int load = (ht->index.count + ht->old.count) * 100 / ht->index.size;
+  if (load < 10) {
+    ht_resize(ht, ht->index.size / 2);
+  }
+}
+
+// Start filling a new index, the slots move over the next operations. Only
+// one resize at a time: one due before the last one is done finishes it.
+static int ht_resize(ht_hash_table *ht, const int size) {
+  if (size < HT_INITIAL_SIZE) {
+    return 0;
+  }
+
+  while (ht->old.slots != NULL) {
+    ht_migrate(ht);
+  }
+
+  ht_index index;
+  if (ht_index_init(&index, size) < 0) {
+    return -1;
+  }
+
+  ht->old = ht->index;
+  ht->index = index;
+  ht->old_position = 0;
+  return 0;
+}
+
+const char *ht_backend() { return "swiss table, " HT_GROUP_ENGINE; }
+
+#endif // HT_SWISS
@@ -1,7 +0,0 @@
-#ifndef PRIME_H
-#define PRIME_H
-
-int is_prime(const int x);
-int next_prime(int x);
-
-#endif // PRIME_H
@@ -0,0 +1,313 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../hash_table/hash_table_internal.h"
+#include "phash.h"
+
+// Average keys per bucket: bigger buckets make the tables smaller and the
+// build slower
+#define PHASH_BUCKET_KEYS 4
+#define PHASH_MAX_DISPLACEMENT (1u << 30)
+
+uint64_t phash_key_hash(const char *key, size_t len) {
+  return ht_hash(key, len);
+}
+
+// 32 random bits scaled to [0, n) with a multiply instead of a modulo
+static inline uint32_t phash_range(uint32_t bits, uint32_t n) {
+  return (uint32_t)(((uint64_t)bits * n) >> 32);
+}
+
+// The bucket comes from the high half of the hash, the slot from all of it
+// mixed with the displacement
+uint32_t phash_bucket(uint64_t hash, uint32_t buckets) {
+  return phash_range((uint32_t)(hash >> 32), buckets);
+}
+
+uint32_t phash_slot(uint64_t hash, uint32_t displacement, uint32_t count) {
+  // Odd multiplier whatever the displacement
+  const uint64_t m = HT_SECRET_1 ^ ((uint64_t)displacement << 1);
+  return phash_range((uint32_t)ht_mix(hash ^ HT_SECRET_0, m), count);
+}
+
+static const char *phash_lookup(const phash_table *t, const char *key,
+                                const size_t len, const uint64_t hash,
+                                const int fold) {
+  if (t->count == 0) {
+    return NULL;
+  }
+
+  const uint32_t displacement =
+      t->displacements[phash_bucket(hash, t->buckets)];
+  const phash_entry *e = &t->entries[phash_slot(hash, displacement, t->count)];
+
+  // Offsets are checked here rather than for every entry when a dictionary
+  // is mapped, which would read all of it
+  if (e->hash != hash || (uint64_t)e->key + len >= t->strings_size ||
+      e->value >= t->strings_size || t->strings[e->key + len] != '\0' ||
+      !ht_key_equal(t->strings + e->key, key, len, fold)) {
+    return NULL;
+  }
+  return t->strings + e->value;
+}
+
+const char *phash_search(const phash_table *t, const char *key) {
+  const size_t len = strlen(key);
+  return phash_lookup(t, key, len, phash_key_hash(key, len), 0);
+}
+
+const char *phash_search_fold(const phash_table *t, const char *key,
+                              size_t len) {
+  return phash_lookup(t, key, len, ht_hash_fold(key, len), 1);
+}
+
+// Build
+//
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+typedef struct {
+  uint32_t bucket;
+  uint32_t size;
+  uint32_t first; // of its keys in the grouped order
+} phash_bucket_info;
+
+static int compare_by_size(const void *a, const void *b) {
+  const phash_bucket_info *x = a, *y = b;
+  if (x->size != y->size) {
+    return x->size < y->size ? 1 : -1;
+  }
+  return x->bucket < y->bucket ? -1 : x->bucket > y->bucket;
+}
+
+// Group the keys of every bucket together in order, biggest bucket first
+static void phash_group(const uint64_t *hashes, uint32_t count,
+                        uint32_t bucket_count, uint32_t *order,
+                        phash_bucket_info *info, uint32_t *fill) {
+  for (uint32_t b = 0; b < bucket_count; b++) {
+    info[b].bucket = b;
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    info[phash_bucket(hashes[i], bucket_count)].size++;
+  }
+
+  uint32_t first = 0;
+  for (uint32_t b = 0; b < bucket_count; b++) {
+    info[b].first = first;
+    first += info[b].size;
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t b = phash_bucket(hashes[i], bucket_count);
+    order[info[b].first + fill[b]++] = i;
+  }
+
+  qsort(info, bucket_count, sizeof(phash_bucket_info), compare_by_size);
+}
+
+// Try displacements until all the keys of the bucket land on distinct free
+// slots
+static int phash_place(const uint64_t *hashes, uint32_t count,
+                       const uint32_t *keys, uint32_t size,
+                       unsigned char *taken, uint32_t *slots) {
+  for (uint32_t k = 1; k < size; k++) {
+    for (uint32_t j = 0; j < k; j++) {
+      if (hashes[keys[k]] == hashes[keys[j]]) {
+        fprintf(stderr, "Two keys have the same hash, no perfect hash\n");
+        return -1;
+      }
+    }
+  }
+
+  for (uint32_t d = 0; d < PHASH_MAX_DISPLACEMENT; d++) {
+    uint32_t placed = 0;
+    for (; placed < size; placed++) {
+      uint32_t slot = phash_slot(hashes[keys[placed]], d, count);
+      if (taken[slot]) {
+        break;
+      }
+      taken[slot] = 1;
+      slots[keys[placed]] = slot;
+    }
+    if (placed == size) {
+      return (int)d;
+    }
+
+    // Undo the partial placement
+    for (uint32_t k = 0; k < placed; k++) {
+      taken[slots[keys[k]]] = 0;
+    }
+  }
+
+  fprintf(stderr, "No displacement found for a bucket\n");
+  return -1;
+}
+
+// Place the biggest buckets first, while most slots are free. Returns the
+// displacement of every bucket and the slot of every key, or -1 if two keys
+// share their 64-bit hash (no displacement can split them).
+int phash_build(const uint64_t *hashes, uint32_t count, uint32_t *buckets,
+                uint32_t **displacements, uint32_t **slots) {
+  uint32_t bucket_count = count / PHASH_BUCKET_KEYS;
+  if (bucket_count == 0) {
+    bucket_count = 1;
+  }
+
+  uint32_t *order = malloc((count + 1) * sizeof(uint32_t));
+  uint32_t *fill = calloc(bucket_count, sizeof(uint32_t));
+  phash_bucket_info *info = calloc(bucket_count, sizeof(phash_bucket_info));
+  unsigned char *taken = calloc(count + 1, 1);
+  *displacements = calloc(bucket_count, sizeof(uint32_t));
+  *slots = malloc((count + 1) * sizeof(uint32_t));
+  int res = -1;
+
+  if (order == NULL || fill == NULL || info == NULL || taken == NULL ||
+      *displacements == NULL || *slots == NULL) {
+    perror("Failed to allocate the perfect hash");
+  } else {
+    phash_group(hashes, count, bucket_count, order, info, fill);
+
+    res = 0;
+    for (uint32_t b = 0; b < bucket_count && info[b].size > 0; b++) {
+      int d = phash_place(hashes, count, &order[info[b].first], info[b].size,
+                          taken, *slots);
+      if (d < 0) {
+        res = -1;
+        break;
+      }
+      (*displacements)[info[b].bucket] = (uint32_t)d;
+    }
+  }
+
+  free(order);
+  free(fill);
+  free(info);
+  free(taken);
+  if (res < 0) {
+    free(*displacements);
+    free(*slots);
+    *displacements = NULL;
+    *slots = NULL;
+    return -1;
+  }
+
+  *buckets = bucket_count;
+  return 0;
+}
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+// Binary dictionary
+//
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+// A section fits in the file and starts on 8 bytes
+static int phash_file_section(const phash_file_header *h, uint64_t offset,
+                              uint64_t size) {
+  return offset % 8 == 0 && offset >= sizeof(phash_file_header) &&
+         offset <= h->size && size <= h->size - offset;
+}
+
+static int phash_file_table_open(const phash_file_header *h, const char *map,
+                                 const phash_file_table *ft, phash_table *t) {
+  if ((ft->count > 0 && ft->buckets == 0) ||
+      !phash_file_section(h, ft->displacements,
+                          (uint64_t)ft->buckets * sizeof(uint32_t)) ||
+      !phash_file_section(h, ft->entries,
+                          (uint64_t)ft->count * sizeof(phash_entry)) ||
+      !phash_file_section(h, ft->phrases,
+                          (uint64_t)ft->phrase_count * sizeof(uint32_t))) {
+    return -1;
+  }
+
+  t->count = ft->count;
+  t->buckets = ft->buckets;
+  t->displacements = (const uint32_t *)(map + ft->displacements);
+  t->entries = (const phash_entry *)(map + ft->entries);
+  t->strings = map + h->strings;
+  t->strings_size = h->strings_size;
+  t->phrases = (const uint32_t *)(map + ft->phrases);
+  t->phrase_count = ft->phrase_count;
+  return 0;
+}
+
+// Everything but the entries themselves is checked before the tables are
+// used: phash_search checks the offsets of the entries it reads
+static int phash_file_check(const char *path, const phash_file_header *h,
+                            size_t size) {
+  if (h->byte_order != PHASH_FILE_BYTE_ORDER) {
+    fprintf(stderr, "%s: dictionary written with another byte order\n", path);
+    return -1;
+  }
+  if (h->version != PHASH_FILE_VERSION) {
+    fprintf(stderr, "%s: dictionary version %u, this server reads %u\n", path,
+            h->version, PHASH_FILE_VERSION);
+    return -1;
+  }
+  if (h->size != size || h->strings_size == 0 ||
+      !phash_file_section(h, h->strings, h->strings_size) ||
+      ((const char *)h)[h->strings + h->strings_size - 1] != '\0') {
+    fprintf(stderr, "%s: dictionary truncated or corrupted\n", path);
+    return -1;
+  }
+  return 0;
+}
+
+int phash_file_open(const char *path, phash_file *f) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    perror("Error opening file");
+    return -1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    perror("Error reading file");
+    close(fd);
+    return -1;
+  }
+
+  // Shorter than a header or without the magic: a text vocabulary
+  char magic[sizeof(((phash_file_header *)0)->magic)];
+  if ((size_t)st.st_size < sizeof(phash_file_header) ||
+      pread(fd, magic, sizeof(magic), 0) != (ssize_t)sizeof(magic) ||
+      memcmp(magic, PHASH_FILE_MAGIC, sizeof(magic)) != 0) {
+    close(fd);
+    return 1;
+  }
+
+  f->size = (size_t)st.st_size;
+  f->map = mmap(NULL, f->size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (f->map == MAP_FAILED) {
+    perror("Failed to map the dictionary");
+    return -1;
+  }
+  // Lookups jump around the tables, read ahead would only waste memory
+  madvise(f->map, f->size, MADV_RANDOM);
+
+  const phash_file_header *h = f->map;
+  if (phash_file_check(path, h, f->size) < 0) {
+    phash_file_close(f);
+    return -1;
+  }
+  if (phash_file_table_open(h, f->map, &h->source_to_target,
+                            &f->source_to_target) < 0 ||
+      phash_file_table_open(h, f->map, &h->target_to_source,
+                            &f->target_to_source) < 0) {
+    fprintf(stderr, "%s: dictionary tables out of the file\n", path);
+    phash_file_close(f);
+    return -1;
+  }
+  return 0;
+}
+
+void phash_file_close(phash_file *f) {
+  if (f->map != NULL) {
+    munmap(f->map, f->size);
+    f->map = NULL;
+  }
+}
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
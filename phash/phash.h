@@ -0,0 +1,108 @@
+#ifndef PHASH_H
+#define PHASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Minimal perfect hash of a static key set (hash and displace, CHD style).
+// Keys are split in buckets by their hash, every bucket got a displacement at
+// build time that sends all its keys to free slots, so n keys fill exactly n
+// slots and a lookup reads one displacement and one slot, never probes.
+
+typedef struct {
+  uint64_t hash;  // full hash of the key, a miss rarely reads the strings
+  uint32_t key;   // offset of the key in the strings
+  uint32_t value; // offset of the value in the strings
+} phash_entry;
+
+// Read-only tables, built by vocab_compiler
+typedef struct {
+  uint32_t count; // keys, also the number of entries
+  uint32_t buckets;
+  const uint32_t *displacements; // one per bucket
+  const phash_entry *entries;
+  const char *strings; // NUL terminated keys and values
+  uint64_t strings_size;
+  const uint32_t *phrases; // entries whose key is a phrase (phrase/)
+  uint32_t phrase_count;
+} phash_table;
+
+// Both directions of one vocabulary file, with the size and modification
+// time the file had when it was compiled
+typedef struct {
+  const char *path;
+  long long size;
+  long long mtime;
+  phash_table source_to_target;
+  phash_table target_to_source;
+} phash_vocab;
+
+const char *phash_search(const phash_table *t, const char *key);
+
+// For tables of folded keys: see ht_search_fold (hash_table/hash_table.h)
+const char *phash_search_fold(const phash_table *t, const char *key,
+                              size_t len);
+
+uint64_t phash_key_hash(const char *key, size_t len);
+uint32_t phash_bucket(uint64_t hash, uint32_t buckets);
+uint32_t phash_slot(uint64_t hash, uint32_t displacement, uint32_t count);
+
+int phash_build(const uint64_t *hashes, uint32_t count, uint32_t *buckets,
+                uint32_t **displacements, uint32_t **slots);
+
+// Binary dictionary
+//
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+// The same tables as a file, mapped read-only and used in place, so every
+// server sharing it shares the page cache too. Sections are referred to by
+// their offset from the start of the file, never by address:
+//
+//   header | strings | forward displacements, entries, phrases | reverse ...
+//
+// every section starting on 8 bytes. Numbers are in the byte order of the
+// machine that wrote the file, byte_order tells a reader when it isn't its
+// own.
+#define PHASH_FILE_MAGIC "CHATDICT"
+#define PHASH_FILE_VERSION 3 // 2: keys folded, 3: phrase lists
+#define PHASH_FILE_BYTE_ORDER 0x01020304u
+
+typedef struct {
+  uint32_t count;
+  uint32_t buckets;
+  uint64_t displacements; // offsets in the file
+  uint64_t entries;
+  uint64_t phrases;
+  uint32_t phrase_count;
+  uint32_t reserved;
+} phash_file_table;
+
+typedef struct {
+  char magic[8]; // PHASH_FILE_MAGIC, without the NUL
+  uint32_t version;
+  uint32_t byte_order; // PHASH_FILE_BYTE_ORDER as written
+  uint64_t size;       // of the whole file
+  uint64_t strings;
+  uint64_t strings_size;
+  phash_file_table source_to_target;
+  phash_file_table target_to_source;
+} phash_file_header;
+
+typedef struct {
+  void *map;
+  size_t size;
+  phash_table source_to_target;
+  phash_table target_to_source;
+} phash_file;
+
+// 0 when the file was mapped, 1 when it isn't a binary dictionary at all
+// (a text vocabulary), -1 on errors and on dictionaries this build can't read
+int phash_file_open(const char *path, phash_file *f);
+void phash_file_close(phash_file *f);
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+// Defined by the source file vocab_compiler generates
+extern const phash_vocab phash_vocabs[];
+extern const int phash_vocab_count;
+
+#endif // PHASH_H
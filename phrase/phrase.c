@@ -0,0 +1,311 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "../hash_table/hash_table_internal.h"
+#include "phrase.h"
+
+#define PHRASE_INITIAL_EDGES 64
+#define PHRASE_INITIAL_NODES 64
+#define PHRASE_INITIAL_ARENA 4096
+
+// The word hash is the one every table uses, mixed with the parent so the
+// same word under different nodes lands in different slots
+static inline uint64_t phrase_edge_hash(const uint32_t parent,
+                                        const uint64_t word_hash) {
+  return ht_mix(word_hash ^ HT_SECRET_2,
+                ((uint64_t)parent << 1 | 1) ^ HT_SECRET_1);
+}
+
+phrase_dictionary *phrase_dictionary_new() {
+  phrase_dictionary *d = calloc(1, sizeof(phrase_dictionary));
+  if (d == NULL) {
+    return NULL;
+  }
+
+  d->first.slots = calloc(PHRASE_INITIAL_EDGES, sizeof(phrase_edge));
+  d->next.slots = calloc(PHRASE_INITIAL_EDGES, sizeof(phrase_edge));
+  d->values = malloc(PHRASE_INITIAL_NODES * sizeof(uint32_t));
+  d->arena = malloc(PHRASE_INITIAL_ARENA);
+  if (d->first.slots == NULL || d->next.slots == NULL || d->values == NULL ||
+      d->arena == NULL) {
+    phrase_dictionary_free(d);
+    return NULL;
+  }
+
+  d->first.mask = PHRASE_INITIAL_EDGES - 1;
+  d->next.mask = PHRASE_INITIAL_EDGES - 1;
+  d->values[0] = 0;
+  d->node_count = 1;
+  d->node_capacity = PHRASE_INITIAL_NODES;
+
+  // Offset 0 is never a string
+  d->arena[0] = '\0';
+  d->arena_len = 1;
+  d->arena_capacity = PHRASE_INITIAL_ARENA;
+  return d;
+}
+
+void phrase_dictionary_free(phrase_dictionary *d) {
+  if (d == NULL) {
+    return;
+  }
+
+  free(d->first.slots);
+  free(d->next.slots);
+  free(d->values);
+  free(d->arena);
+  free(d);
+}
+
+static void *phrase_copy_of(const void *p, const size_t size) {
+  void *copy = malloc(size);
+  if (copy != NULL) {
+    memcpy(copy, p, size);
+  }
+  return copy;
+}
+
+phrase_dictionary *phrase_dictionary_copy(const phrase_dictionary *d) {
+  phrase_dictionary *copy = malloc(sizeof(phrase_dictionary));
+  if (copy == NULL) {
+    return NULL;
+  }
+
+  *copy = *d;
+  copy->first.slots = phrase_copy_of(
+      d->first.slots, (d->first.mask + 1) * sizeof(phrase_edge));
+  copy->next.slots =
+      phrase_copy_of(d->next.slots, (d->next.mask + 1) * sizeof(phrase_edge));
+  copy->values =
+      phrase_copy_of(d->values, d->node_capacity * sizeof(uint32_t));
+  copy->arena = phrase_copy_of(d->arena, d->arena_capacity);
+  if (copy->first.slots == NULL || copy->next.slots == NULL ||
+      copy->values == NULL || copy->arena == NULL) {
+    phrase_dictionary_free(copy);
+    return NULL;
+  }
+  return copy;
+}
+
+size_t phrase_key_words(const char *key, size_t len, token *words) {
+  if (len > PHRASE_MAX_KEY) {
+    return 0;
+  }
+
+  token tokens[TOKENIZER_MAX_TOKENS(PHRASE_MAX_KEY)];
+  const size_t count = tokenizer_split(key, len, tokens);
+  if (count < 2 || count > PHRASE_MAX_WORDS) {
+    return 0;
+  }
+
+  size_t position = 0;
+  for (size_t i = 0; i <= count; i++) {
+    const size_t next = i < count ? tokens[i].start : len;
+    for (; position < next; position++) {
+      if (key[position] != ' ') {
+        return 0;
+      }
+    }
+    if (i < count) {
+      position = tokens[i].start + tokens[i].len;
+    }
+  }
+
+  memcpy(words, tokens, count * sizeof(token));
+  return count;
+}
+
+static inline phrase_edges *phrase_edges_of(phrase_dictionary *d,
+                                            const uint32_t parent) {
+  return parent == 0 ? &d->first : &d->next;
+}
+
+// Child of parent along word, 0 if there's no such edge
+static uint32_t phrase_find(const phrase_dictionary *d, const uint32_t parent,
+                            const char *word, const size_t len,
+                            const uint64_t hash) {
+  const phrase_edges *edges = parent == 0 ? &d->first : &d->next;
+  for (uint32_t i = (uint32_t)hash & edges->mask;;
+       i = (i + 1) & edges->mask) {
+    const phrase_edge *e = &edges->slots[i];
+    if (e->child == 0) {
+      return 0;
+    }
+    if (e->hash == hash && e->parent == parent && e->word_len == len &&
+        ht_key_equal(d->arena + e->word, word, len, 1)) {
+      return e->child;
+    }
+  }
+}
+
+// Build
+//
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+// Copy s at the end of the arena, folded when fold is set, returns its
+// offset or 0
+static uint32_t phrase_arena_append(phrase_dictionary *d, const char *s,
+                                    const size_t len, const int fold) {
+  if (d->arena_len + len + 1 > UINT32_MAX) {
+    return 0;
+  }
+
+  if (d->arena_len + len + 1 > d->arena_capacity) {
+    size_t capacity = d->arena_capacity * 2;
+    while (capacity < d->arena_len + len + 1) {
+      capacity *= 2;
+    }
+
+    char *arena = realloc(d->arena, capacity);
+    if (arena == NULL) {
+      return 0;
+    }
+    d->arena = arena;
+    d->arena_capacity = capacity;
+  }
+
+  char *copy = d->arena + d->arena_len;
+  for (size_t i = 0; i < len; i++) {
+    copy[i] = fold ? ht_fold_char(s[i]) : s[i];
+  }
+  copy[len] = '\0';
+
+  const uint32_t offset = (uint32_t)d->arena_len;
+  d->arena_len += len + 1;
+  return offset;
+}
+
+static void phrase_edge_place(phrase_edge *edges, const uint32_t mask,
+                              const phrase_edge *e) {
+  uint32_t i = (uint32_t)e->hash & mask;
+  while (edges[i].child != 0) {
+    i = (i + 1) & mask;
+  }
+  edges[i] = *e;
+}
+
+// Edges keep their hash, a bigger table only places them again
+static int phrase_edges_grow(phrase_edges *edges) {
+  const uint32_t size = (edges->mask + 1) * 2;
+  phrase_edge *slots = calloc(size, sizeof(phrase_edge));
+  if (slots == NULL) {
+    return -1;
+  }
+
+  for (uint32_t i = 0; i <= edges->mask; i++) {
+    if (edges->slots[i].child != 0) {
+      phrase_edge_place(slots, size - 1, &edges->slots[i]);
+    }
+  }
+
+  free(edges->slots);
+  edges->slots = slots;
+  edges->mask = size - 1;
+  return 0;
+}
+
+// A child of parent along word, new with its edge
+static uint32_t phrase_node_add(phrase_dictionary *d, const uint32_t parent,
+                                const char *word, const size_t len,
+                                const uint64_t hash) {
+  if (d->node_count == d->node_capacity) {
+    uint32_t *values =
+        realloc(d->values, d->node_capacity * 2 * sizeof(uint32_t));
+    if (values == NULL) {
+      return 0;
+    }
+    d->values = values;
+    d->node_capacity *= 2;
+  }
+
+  phrase_edges *edges = phrase_edges_of(d, parent);
+  if ((uint64_t)(edges->count + 1) * 10 > (uint64_t)(edges->mask + 1) * 7 &&
+      phrase_edges_grow(edges) < 0) {
+    return 0;
+  }
+
+  const uint32_t offset = phrase_arena_append(d, word, len, 1);
+  if (offset == 0) {
+    return 0;
+  }
+
+  const uint32_t child = d->node_count++;
+  d->values[child] = 0;
+
+  const phrase_edge e = {hash, parent, child, offset, (uint32_t)len};
+  phrase_edge_place(edges->slots, edges->mask, &e);
+  edges->count++;
+  return child;
+}
+
+int phrase_dictionary_add(phrase_dictionary *d, const char *key,
+                          const char *value) {
+  token words[PHRASE_MAX_WORDS];
+  const size_t count = phrase_key_words(key, strlen(key), words);
+  if (count == 0) {
+    return 0;
+  }
+
+  uint32_t node = 0;
+  for (size_t i = 0; i < count; i++) {
+    const char *word = key + words[i].start;
+    const size_t len = words[i].len;
+    const uint64_t hash = phrase_edge_hash(node, ht_hash_fold(word, len));
+
+    uint32_t child = phrase_find(d, node, word, len, hash);
+    if (child == 0) {
+      child = phrase_node_add(d, node, word, len, hash);
+      if (child == 0) {
+        return -1;
+      }
+    }
+    node = child;
+  }
+
+  const uint32_t offset = phrase_arena_append(d, value, strlen(value), 0);
+  if (offset == 0) {
+    return -1;
+  }
+  d->values[node] = offset;
+  if (count > d->max_words) {
+    d->max_words = (uint32_t)count;
+  }
+  return 1;
+}
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+size_t phrase_dictionary_match(const phrase_dictionary *d,
+                               const char *message, const token *words,
+                               size_t count, const char **value) {
+  if (count > d->max_words) {
+    count = d->max_words;
+  }
+
+  size_t longest = 0;
+  uint32_t node = 0;
+  for (size_t i = 0; i < count; i++) {
+    // Spaces only since the previous word, or the phrase is over
+    if (i > 0) {
+      for (size_t p = words[i - 1].start + words[i - 1].len;
+           p < words[i].start; p++) {
+        if (message[p] != ' ') {
+          return longest;
+        }
+      }
+    }
+
+    const char *word = message + words[i].start;
+    const uint64_t hash =
+        phrase_edge_hash(node, ht_hash_fold(word, words[i].len));
+    node = phrase_find(d, node, word, words[i].len, hash);
+    if (node == 0) {
+      break;
+    }
+
+    if (d->values[node] != 0) {
+      longest = i + 1;
+      *value = d->arena + d->values[node];
+    }
+  }
+  return longest;
+}
@@ -0,0 +1,83 @@
+#ifndef PHRASE_H
+#define PHRASE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../tokenizer/tokenizer.h"
+
+// Dictionary of phrases, keys of more than one word ("va bene"), as a trie
+// over words: every node is a sequence of words, every edge one more word.
+// Edges are in hash tables keyed by parent node and word, so following one
+// is one probe however many children the node has. The first words of the
+// phrases have a table of their own: every word of a message is looked up
+// there, and it stays small enough to be in cache.
+//
+// A message is matched from every word on: the walk follows the words as
+// long as there's an edge for them, remembering the last node where a phrase
+// ends, and the longest phrase starting at the word wins. A walk is at most
+// as deep as the longest phrase, and a word that starts no phrase costs one
+// probe, so the pass over a message stays linear in its words.
+//
+// Words are stored folded (hash_table.h) and match in any case. Inside a
+// phrase they're separated by spaces only, in keys and in messages.
+
+#define PHRASE_MAX_WORDS 16
+#define PHRASE_MAX_KEY 256 // bytes, longer keys are no phrases
+
+typedef struct {
+  uint64_t hash; // of parent and word
+  uint32_t parent;
+  uint32_t child; // 0 when the slot is empty, the root is no child
+  uint32_t word;  // arena offset of the folded word
+  uint32_t word_len;
+} phrase_edge;
+
+// Open addressing with linear probing
+typedef struct {
+  phrase_edge *slots;
+  uint32_t mask;
+  uint32_t count;
+} phrase_edges;
+
+typedef struct {
+  phrase_edges first; // from the root
+  phrase_edges next;  // from every other node
+
+  // Per node, the arena offset of the translation of the phrase ending
+  // there, 0 if none does. Node 0 is the root.
+  uint32_t *values;
+  uint32_t node_count;
+  uint32_t node_capacity;
+  uint32_t max_words; // of the longest phrase
+
+  char *arena;
+  size_t arena_len;
+  size_t arena_capacity;
+} phrase_dictionary;
+
+phrase_dictionary *phrase_dictionary_new();
+void phrase_dictionary_free(phrase_dictionary *d);
+
+// A dictionary read by other threads is never changed: phrases are added to
+// a copy, swapped in for it
+phrase_dictionary *phrase_dictionary_copy(const phrase_dictionary *d);
+
+// Words of key if it's a phrase: at least two and at most PHRASE_MAX_WORDS,
+// with nothing but spaces between and around them. Returns how many, 0 when
+// it's no phrase; words needs room for PHRASE_MAX_WORDS.
+size_t phrase_key_words(const char *key, size_t len, token *words);
+
+// Adds key -> value, or replaces the value. Returns 1 when added, 0 when key
+// is no phrase, -1 when out of memory.
+int phrase_dictionary_add(phrase_dictionary *d, const char *key,
+                          const char *value);
+
+// Longest phrase of the message starting at words[0], the following count -
+// 1 words being the rest of the message. Returns how many words it covers
+// with its translation in value, or 0 when no phrase starts there.
+size_t phrase_dictionary_match(const phrase_dictionary *d,
+                               const char *message, const token *words,
+                               size_t count, const char **value);
+
+#endif // PHRASE_H
@@ -0,0 +1,133 @@
+#include <arpa/inet.h>
+#include <string.h>
+
+#include "protocol.h"
+
+size_t proto_frame_size(size_t username_len, size_t body_len) {
+  return PROTO_HEADER_SIZE + 2 + username_len + body_len;
+}
+
+// Write the header and username of a frame into out, the caller writes its
+// body_len bytes of body right after them, at out +
+// proto_frame_size(username_len, 0). Returns the size of the whole frame or
+// 0 if it doesn't fit or breaks a protocol limit.
+size_t proto_encode_header(char *out, size_t out_size, proto_type type,
+                           uint16_t flags, const char *username,
+                           size_t username_len, size_t body_len) {
+  size_t size = proto_frame_size(username_len, body_len);
+  if (username_len > PROTO_MAX_USERNAME || body_len > PROTO_MAX_BODY ||
+      size > out_size) {
+    return 0;
+  }
+
+  uint32_t payload_len = htonl((uint32_t)(size - PROTO_HEADER_SIZE));
+  uint16_t net_flags = htons(flags);
+  uint16_t net_username_len = htons((uint16_t)username_len);
+
+  memcpy(out, &payload_len, 4);
+  out[4] = PROTO_VERSION;
+  out[5] = (char)type;
+  memcpy(out + 6, &net_flags, 2);
+  memcpy(out + 8, &net_username_len, 2);
+  if (username_len > 0) {
+    memcpy(out + 10, username, username_len);
+  }
+
+  return size;
+}
+
+// Write one frame into out, returns its size or 0 if it doesn't fit or
+// breaks a protocol limit
+size_t proto_encode(char *out, size_t out_size, proto_type type,
+                    uint16_t flags, const char *username, size_t username_len,
+                    const char *body, size_t body_len) {
+  size_t size = proto_encode_header(out, out_size, type, flags, username,
+                                    username_len, body_len);
+  if (size > 0 && body_len > 0) {
+    memcpy(out + 10 + username_len, body, body_len);
+  }
+
+  return size;
+}
+
+void proto_parser_init(proto_parser *p) {
+  p->start = 0;
+  p->end = 0;
+}
+
+// Append received bytes, returns how many were taken: when the buffer is full
+// the caller must take the complete frames out and feed the rest again
+size_t proto_parser_feed(proto_parser *p, const char *data, size_t len) {
+  // Frames already taken out are dropped only now, so they stay valid until
+  // the next feed
+  if (p->start > 0) {
+    memmove(p->buffer, p->buffer + p->start, p->end - p->start);
+    p->end -= p->start;
+    p->start = 0;
+  }
+
+  size_t space = sizeof(p->buffer) - p->end;
+  if (len > space) {
+    len = space;
+  }
+
+  memcpy(p->buffer + p->end, data, len);
+  p->end += len;
+  return len;
+}
+
+// Decode the frame at the start of data: returns its size and fills frame, 0
+// if data holds only part of it, -1 if it's not a frame of this protocol
+long proto_decode(const char *data, size_t len, proto_frame *frame) {
+  if (len < PROTO_HEADER_SIZE) {
+    return 0;
+  }
+
+  uint32_t payload_len;
+  memcpy(&payload_len, data, 4);
+  payload_len = ntohl(payload_len);
+
+  if ((uint8_t)data[4] != PROTO_VERSION || payload_len < 2 ||
+      payload_len > PROTO_MAX_PAYLOAD) {
+    return -1;
+  }
+
+  if (len < PROTO_HEADER_SIZE + payload_len) {
+    return 0;
+  }
+
+  uint16_t flags, username_len;
+  memcpy(&flags, data + 6, 2);
+  memcpy(&username_len, data + 8, 2);
+  username_len = ntohs(username_len);
+
+  if (username_len > PROTO_MAX_USERNAME || username_len > payload_len - 2) {
+    return -1;
+  }
+
+  frame->version = (uint8_t)data[4];
+  frame->type = (uint8_t)data[5];
+  frame->flags = ntohs(flags);
+  frame->username = data + 10;
+  frame->username_len = username_len;
+  frame->body = data + 10 + username_len;
+  frame->body_len = payload_len - 2 - username_len;
+
+  if (frame->body_len > PROTO_MAX_BODY) {
+    return -1;
+  }
+
+  return PROTO_HEADER_SIZE + payload_len;
+}
+
+// Take the next complete frame: returns 1 and fills frame, 0 if more bytes
+// are needed, -1 if the stream is not speaking this protocol
+int proto_parser_next(proto_parser *p, proto_frame *frame) {
+  long size = proto_decode(p->buffer + p->start, p->end - p->start, frame);
+  if (size <= 0) {
+    return (int)size;
+  }
+
+  p->start += size;
+  return 1;
+}
@@ -0,0 +1,62 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Wire format shared by the client and the server. Every message is a frame:
+//
+//   u32 payload length | u8 version | u8 type | u16 flags    (network order)
+//   u16 username length | username | body                     (payload)
+//
+// so a reader always knows where a message ends, no matter how TCP splits or
+// coalesces the bytes.
+
+#define PROTO_VERSION 1
+#define PROTO_HEADER_SIZE 8
+#define PROTO_MAX_USERNAME 255
+#define PROTO_MAX_BODY 1024
+#define PROTO_MAX_PAYLOAD (2 + PROTO_MAX_USERNAME + PROTO_MAX_BODY)
+#define PROTO_MAX_FRAME (PROTO_HEADER_SIZE + PROTO_MAX_PAYLOAD)
+
+typedef enum {
+  PROTO_CHAT = 1,   // a chat message, translated when sent by the server
+  PROTO_LOCKED,     // server: the room is full, you are in the queue
+  PROTO_NOT_LOCKED, // server: a seat is free, connect again to take it
+  PROTO_KICKED,     // client: leaving the room for inactivity
+} proto_type;
+
+// A decoded frame, username and body point into the parser buffer and are
+// not NUL terminated
+typedef struct {
+  uint8_t version;
+  uint8_t type;
+  uint16_t flags;
+  const char *username;
+  size_t username_len;
+  const char *body;
+  size_t body_len;
+} proto_frame;
+
+// Incremental decoder: feed it whatever recv returned, then take out every
+// complete frame. A frame stays valid until the next feed.
+typedef struct {
+  char buffer[2 * PROTO_MAX_FRAME];
+  size_t start;
+  size_t end;
+} proto_parser;
+
+size_t proto_frame_size(size_t username_len, size_t body_len);
+size_t proto_encode(char *out, size_t out_size, proto_type type,
+                    uint16_t flags, const char *username, size_t username_len,
+                    const char *body, size_t body_len);
+size_t proto_encode_header(char *out, size_t out_size, proto_type type,
+                           uint16_t flags, const char *username,
+                           size_t username_len, size_t body_len);
+long proto_decode(const char *data, size_t len, proto_frame *frame);
+
+void proto_parser_init(proto_parser *p);
+size_t proto_parser_feed(proto_parser *p, const char *data, size_t len);
+int proto_parser_next(proto_parser *p, proto_frame *frame);
+
+#endif // PROTOCOL_H
@@ -0,0 +1,82 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "rcu.h"
+
+static atomic_ulong rcu_epoch = 1;
+static rcu_reader rcu_readers[RCU_MAX_READERS];
+
+// Threads take a record the first time they read and give it back when they
+// exit, so the records are only as many as the threads reading at once
+static pthread_once_t rcu_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t rcu_key;
+static __thread rcu_reader *current_reader = NULL;
+static __thread int read_depth = 0;
+
+static void rcu_reader_release(void *arg) {
+  rcu_reader *r = arg;
+  atomic_store_explicit(&r->epoch, 0, memory_order_release);
+  atomic_store_explicit(&r->used, 0, memory_order_release);
+}
+
+static void rcu_key_create() {
+  if (pthread_key_create(&rcu_key, rcu_reader_release) != 0) {
+    perror("Failed to create the RCU thread key");
+    exit(EXIT_FAILURE);
+  }
+}
+
+static rcu_reader *rcu_reader_get() {
+  if (current_reader != NULL) {
+    return current_reader;
+  }
+
+  pthread_once(&rcu_key_once, rcu_key_create);
+  while (1) {
+    for (int i = 0; i < RCU_MAX_READERS; i++) {
+      int unused = 0;
+      if (atomic_compare_exchange_strong(&rcu_readers[i].used, &unused, 1)) {
+        current_reader = &rcu_readers[i];
+        pthread_setspecific(rcu_key, current_reader);
+        return current_reader;
+      }
+    }
+    // More reader threads than records: wait for one to exit
+    sched_yield();
+  }
+}
+
+void rcu_read_lock() {
+  if (read_depth++ > 0) {
+    return;
+  }
+
+  // Sequentially consistent: the stamp is visible to rcu_synchronize before
+  // this thread loads any pointer it protects
+  rcu_reader *r = rcu_reader_get();
+  atomic_store(&r->epoch, atomic_load(&rcu_epoch));
+}
+
+void rcu_read_unlock() {
+  if (--read_depth > 0) {
+    return;
+  }
+
+  atomic_store_explicit(&current_reader->epoch, 0, memory_order_release);
+}
+
+// A reader stamped with the new epoch or later entered after the pointer
+// swap that came before this call, so it can't hold the old version
+void rcu_synchronize() {
+  const unsigned long epoch = atomic_fetch_add(&rcu_epoch, 1);
+
+  for (int i = 0; i < RCU_MAX_READERS; i++) {
+    rcu_reader *r = &rcu_readers[i];
+    unsigned long stamp;
+    while ((stamp = atomic_load(&r->epoch)) != 0 && stamp <= epoch) {
+      sched_yield();
+    }
+  }
+}
@@ -0,0 +1,34 @@
+#ifndef RCU_H
+#define RCU_H
+
+#include <stdatomic.h>
+
+// Read-copy-update for data that is read all the time and replaced rarely.
+// A writer publishes a new version with one atomic pointer store, readers
+// load that pointer between rcu_read_lock and rcu_read_unlock and never wait
+// nor take a lock. The old version is freed only after rcu_synchronize
+// returns: by then every reader that could still see it has left its read
+// section.
+//
+// Grace periods are counted in epochs. A reader stamps its record with the
+// epoch it entered in, rcu_synchronize starts a new epoch and waits until no
+// record is stamped with an older one.
+
+#define RCU_MAX_READERS 1024
+
+// One per reader thread, on its own cache line so readers never share one
+typedef struct {
+  atomic_ulong epoch; // 0 outside of a read section
+  atomic_int used;
+  char padding[64 - sizeof(atomic_ulong) - sizeof(atomic_int)];
+} rcu_reader;
+
+// Read sections can nest, only the outermost one counts
+void rcu_read_lock();
+void rcu_read_unlock();
+
+// Wait for every read section started before the call to end. Blocks the
+// writer only.
+void rcu_synchronize();
+
+#endif // RCU_H
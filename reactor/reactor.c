@@ -0,0 +1,737 @@
+#define _GNU_SOURCE
+
+#include "reactor.h"
+#include "reactor_uring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+static _Thread_local reactor *current_reactor = NULL;
+
+int set_nonblocking(int fd) {
+  int flags = fcntl(fd, F_GETFL, 0);
+  if (flags < 0) {
+    return -1;
+  }
+  return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+const char *reactor_engine_name(reactor_engine engine) {
+  return engine == REACTOR_IO_URING ? "io_uring" : "epoll";
+}
+
+int reactor_engine_from_name(const char *name, reactor_engine *engine) {
+  if (strcmp(name, "epoll") == 0) {
+    *engine = REACTOR_EPOLL;
+    return 0;
+  }
+  if (strcmp(name, "io_uring") == 0 || strcmp(name, "uring") == 0) {
+    *engine = REACTOR_IO_URING;
+    return 0;
+  }
+  return -1;
+}
+
+// Reactor running on the calling thread, NULL outside the reactors
+reactor *reactor_current() { return current_reactor; }
+
+// Buffers
+//
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+reactor_buffer *reactor_buffer_new(const char *data, size_t len) {
+  reactor_buffer *b = malloc(sizeof(reactor_buffer) + len);
+  if (b == NULL) {
+    return NULL;
+  }
+
+  atomic_init(&b->refs, 1);
+  b->len = len;
+  if (data != NULL) {
+    memcpy(b->data, data, len);
+  }
+  return b;
+}
+
+void reactor_buffer_ref(reactor_buffer *b) {
+  atomic_fetch_add_explicit(&b->refs, 1, memory_order_relaxed);
+}
+
+void reactor_buffer_unref(reactor_buffer *b) {
+  if (atomic_fetch_sub_explicit(&b->refs, 1, memory_order_acq_rel) == 1) {
+    free(b);
+  }
+}
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+// Output queue
+//
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+static void stream_queue_push(reactor_stream *s, reactor_buffer *b) {
+  reactor_buffer_ref(b);
+  s->out[(s->out_head + s->out_count) % REACTOR_MAX_QUEUED] = b;
+  s->out_count++;
+  s->out_bytes += b->len;
+  atomic_fetch_add_explicit(&s->owner->metrics.queued_bytes, b->len,
+                            memory_order_relaxed);
+}
+
+// Drop the first count buffers of the queue, they have been sent
+void reactor_stream_pop(reactor_stream *s, int count) {
+  for (int i = 0; i < count; i++) {
+    reactor_buffer *b = s->out[s->out_head];
+    size_t left = b->len - s->out_offset;
+    s->out_bytes -= left;
+    atomic_fetch_sub_explicit(&s->owner->metrics.queued_bytes, left,
+                              memory_order_relaxed);
+    s->out_offset = 0;
+    s->out_head = (s->out_head + 1) % REACTOR_MAX_QUEUED;
+    s->out_count--;
+    reactor_buffer_unref(b);
+  }
+}
+
+// Drop the first len bytes of the queue
+static void stream_queue_consume(reactor_stream *s, size_t len) {
+  while (len > 0) {
+    reactor_buffer *b = s->out[s->out_head];
+    size_t left = b->len - s->out_offset;
+
+    if (len < left) {
+      s->out_offset += len;
+      s->out_bytes -= len;
+      atomic_fetch_sub_explicit(&s->owner->metrics.queued_bytes, len,
+                                memory_order_relaxed);
+      return;
+    }
+
+    len -= left;
+    reactor_stream_pop(s, 1);
+  }
+}
+
+void reactor_stream_discard(reactor_stream *s) {
+  reactor_stream_pop(s, s->out_count);
+}
+
+// Drop the oldest buffer nobody is sending yet: a partially written one
+// (epoll) or the ones handed to the kernel (io_uring) must stay. The buffers
+// before it keep their order. Returns -1 if there is nothing to drop.
+static int stream_queue_drop_oldest(reactor_stream *s) {
+  int first = s->sends_batch + (s->out_offset > 0 ? 1 : 0);
+  if (first >= s->out_count) {
+    return -1;
+  }
+
+  reactor_buffer *b = s->out[(s->out_head + first) % REACTOR_MAX_QUEUED];
+  for (int i = first; i > 0; i--) {
+    s->out[(s->out_head + i) % REACTOR_MAX_QUEUED] =
+        s->out[(s->out_head + i - 1) % REACTOR_MAX_QUEUED];
+  }
+  s->out_head = (s->out_head + 1) % REACTOR_MAX_QUEUED;
+  s->out_count--;
+  s->out_bytes -= b->len;
+  atomic_fetch_sub_explicit(&s->owner->metrics.queued_bytes, b->len,
+                            memory_order_relaxed);
+  reactor_buffer_unref(b);
+  return 0;
+}
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+// Stream lifetime
+//
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+void reactor_stream_ref(reactor_stream *s) {
+  atomic_fetch_add_explicit(&s->refs, 1, memory_order_relaxed);
+}
+
+static void reactor_stream_deliver_release(reactor *r, reactor_task *t) {
+  reactor_stream *s = (reactor_stream *)((char *)t -
+                                         offsetof(reactor_stream, release));
+  s->on_release(r, s);
+}
+
+// The last reference frees the stream on its owner, wherever it's dropped
+void reactor_stream_unref(reactor_stream *s) {
+  if (atomic_fetch_sub_explicit(&s->refs, 1, memory_order_acq_rel) != 1) {
+    return;
+  }
+
+  if (current_reactor == s->owner) {
+    s->on_release(s->owner, s);
+  } else {
+    s->release.run = reactor_stream_deliver_release;
+    reactor_post_task(s->owner, &s->release);
+  }
+}
+
+// Close the socket: the owner forgets the stream first, so nobody can reach
+// a reused fd through it
+void reactor_stream_finish(reactor *r, reactor_stream *s) {
+  s->closing = 1;
+  s->closed = 1;
+  reactor_stream_discard(s);
+
+  s->on_close(r, s);
+  close(s->handler.fd);
+  reactor_stream_unref(s);
+}
+
+static void stream_mark_dirty(reactor *r, reactor_stream *s) {
+  if (s->dirty) {
+    return;
+  }
+
+  reactor_stream_ref(s);
+  s->dirty = 1;
+  s->dirty_next = r->dirty;
+  r->dirty = s;
+}
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+// Backpressure
+//
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+// A stream reached the high watermark: its reader is slower than the room, so
+// it pays for it instead of everyone else. Returns -1 if b can't be queued.
+static int stream_on_congestion(reactor *r, reactor_stream *s,
+                                reactor_buffer *b) {
+  reactor_backpressure *bp = &r->backpressure;
+  reactor_metrics *m = &r->metrics;
+
+  atomic_fetch_add_explicit(&m->congestions, 1, memory_order_relaxed);
+
+  if (bp->policy == REACTOR_DISCONNECT) {
+    atomic_fetch_add_explicit(&m->disconnections, 1, memory_order_relaxed);
+
+    s->failed = 1;
+    s->closing = 1;
+    while (stream_queue_drop_oldest(s) == 0) {
+    }
+
+    // Fails whatever is still being sent, so the stream closes right away
+    shutdown(s->handler.fd, SHUT_RDWR);
+    stream_mark_dirty(r, s);
+    return -1;
+  }
+
+  // Drop down to the low watermark, so the next messages fit again without
+  // dropping one buffer per message
+  while ((s->out_bytes + b->len > bp->low_watermark ||
+          s->out_count == REACTOR_MAX_QUEUED) &&
+         stream_queue_drop_oldest(s) == 0) {
+    atomic_fetch_add_explicit(&m->dropped, 1, memory_order_relaxed);
+  }
+
+  // Everything left is already being sent, b is the one that goes
+  if (s->out_bytes + b->len > bp->high_watermark ||
+      s->out_count == REACTOR_MAX_QUEUED) {
+    atomic_fetch_add_explicit(&m->dropped, 1, memory_order_relaxed);
+    return -1;
+  }
+
+  return 0;
+}
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+// Read flow control
+//
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+// Half way to the high watermark a stream stops reading, so what it sends
+// itself never gets dropped; it reads again once it's back to the low one.
+// Both return 1 when the caller has to act.
+int reactor_stream_pause_reading(reactor *r, reactor_stream *s) {
+  if (s->read_paused || s->out_bytes < r->backpressure.high_watermark / 2) {
+    return 0;
+  }
+
+  s->read_paused = 1;
+  atomic_fetch_add_explicit(&r->metrics.read_pauses, 1, memory_order_relaxed);
+  return 1;
+}
+
+int reactor_stream_resume_reading(reactor *r, reactor_stream *s) {
+  if (!s->read_paused || s->read_held ||
+      s->out_bytes > r->backpressure.low_watermark) {
+    return 0;
+  }
+
+  s->read_paused = 0;
+  return 1;
+}
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+// Mailbox
+//
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+// Lock-free push from any thread, the eventfd is written only by the poster
+// that finds the reactor not already woken up
+void reactor_post_task(reactor *r, reactor_task *t) {
+  t->next = atomic_load_explicit(&r->mailbox, memory_order_relaxed);
+  while (!atomic_compare_exchange_weak_explicit(&r->mailbox, &t->next, t,
+                                                memory_order_release,
+                                                memory_order_relaxed)) {
+  }
+
+  if (atomic_exchange(&r->wakeup_pending, 1) == 0) {
+    uint64_t one = 1;
+    if (write(r->wakeup.fd, &one, sizeof(one)) < 0) {
+      perror("reactor wakeup failed");
+    }
+  }
+}
+
+// Cross-thread handoff of a buffer to a stream's owner
+typedef struct {
+  reactor_task task;
+  reactor_stream *stream;
+  reactor_buffer *buffer;
+} reactor_message;
+
+static void reactor_message_deliver(reactor *r, reactor_task *t) {
+  reactor_message *m = (reactor_message *)t;
+
+  reactor_stream_write_buffer(r, m->stream, m->buffer);
+  reactor_buffer_unref(m->buffer);
+  reactor_stream_unref(m->stream);
+  free(m);
+}
+
+static int reactor_post(reactor *target, reactor_stream *s,
+                        reactor_buffer *b) {
+  reactor_message *m = malloc(sizeof(reactor_message));
+  if (m == NULL) {
+    atomic_fetch_add_explicit(&target->metrics.dropped, 1,
+                              memory_order_relaxed);
+    return -1;
+  }
+
+  m->task.run = reactor_message_deliver;
+  m->stream = s;
+  m->buffer = b;
+  reactor_stream_ref(s);
+  reactor_buffer_ref(b);
+
+  reactor_post_task(target, &m->task);
+  return 0;
+}
+
+void reactor_drain_mailbox(reactor *r) {
+  atomic_store(&r->wakeup_pending, 0);
+  reactor_task *t = atomic_exchange(&r->mailbox, NULL);
+
+  // The mailbox is a stack, reverse it to run the tasks in posting order
+  reactor_task *fifo = NULL;
+  while (t != NULL) {
+    reactor_task *next = t->next;
+    t->next = fifo;
+    fifo = t;
+    t = next;
+  }
+
+  while (fifo != NULL) {
+    reactor_task *next = fifo->next;
+    fifo->run(r, fifo);
+    fifo = next;
+  }
+}
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+// epoll engine
+//
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+// Write as much of the queue as the socket accepts in one sendmsg per
+// REACTOR_MAX_IOV buffers, the rest is written when epoll reports the socket
+// writable again
+static void epoll_stream_flush(reactor_stream *s) {
+  while (s->out_count > 0) {
+    struct iovec iov[REACTOR_MAX_IOV];
+    int iov_count =
+        s->out_count < REACTOR_MAX_IOV ? s->out_count : REACTOR_MAX_IOV;
+
+    for (int i = 0; i < iov_count; i++) {
+      reactor_buffer *b = s->out[(s->out_head + i) % REACTOR_MAX_QUEUED];
+      size_t offset = i == 0 ? s->out_offset : 0;
+      iov[i].iov_base = b->data + offset;
+      iov[i].iov_len = b->len - offset;
+    }
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iov_count;
+
+    ssize_t bytes_sent = sendmsg(s->handler.fd, &msg, MSG_NOSIGNAL);
+    if (bytes_sent < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        s->failed = 1;
+        s->closing = 1;
+        reactor_stream_discard(s);
+      }
+      return;
+    }
+
+    stream_queue_consume(s, bytes_sent);
+  }
+}
+
+static void epoll_stream_finish(reactor *r, reactor_stream *s) {
+  epoll_ctl(r->epoll_fd, EPOLL_CTL_DEL, s->handler.fd, NULL);
+  reactor_stream_finish(r, s);
+}
+
+static void epoll_stream_on_event(reactor *r, reactor_stream *s,
+                                  uint32_t events) {
+  int readable = events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR);
+
+  if (events & EPOLLOUT) {
+    epoll_stream_flush(s);
+
+    // Whatever arrived while paused gets no new edge, read it now
+    if (reactor_stream_resume_reading(r, s)) {
+      readable = 1;
+    }
+  }
+
+  // Edge-triggered: read until the socket is drained, or until the answers
+  // pile up faster than the peer takes them; EPOLLOUT resumes reading then
+  if (readable) {
+    char buffer[REACTOR_RECVBUFSIZE];
+
+    while (!s->closing && !s->read_paused) {
+      ssize_t bytes_received = recv(s->handler.fd, buffer, sizeof(buffer), 0);
+
+      if (bytes_received > 0) {
+        s->on_data(r, s, buffer, bytes_received);
+
+        if (s->out_bytes >= r->backpressure.high_watermark / 2) {
+          epoll_stream_flush(s);
+          reactor_stream_pause_reading(r, s);
+        }
+        continue;
+      }
+
+      if (bytes_received < 0 && errno == EINTR) {
+        continue;
+      }
+      if (bytes_received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        break;
+      }
+
+      // Peer closed or the connection broke, nobody will read the output
+      s->failed = 1;
+      s->closing = 1;
+      reactor_stream_discard(s);
+    }
+  }
+
+  if (s->closing && s->out_count == 0 && !s->dirty) {
+    epoll_stream_finish(r, s);
+  }
+}
+
+static void epoll_flush_dirty(reactor *r) {
+  while (r->dirty != NULL) {
+    reactor_stream *s = r->dirty;
+    r->dirty = s->dirty_next;
+    s->dirty = 0;
+
+    if (!s->closed) {
+      epoll_stream_flush(s);
+      if (s->closing && s->out_count == 0) {
+        epoll_stream_finish(r, s);
+      }
+    }
+
+    reactor_stream_unref(s);
+  }
+}
+
+static void epoll_accept(reactor *r, reactor_listener *l) {
+  while (1) {
+    int client_socket =
+        accept4(l->handler.fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (client_socket < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        perror("accept failed");
+      }
+      return;
+    }
+
+    l->on_accept(r, l, client_socket);
+  }
+}
+
+static void epoll_run(reactor *r) {
+  struct epoll_event events[REACTOR_MAX_EVENTS];
+
+  while (1) {
+    int n = epoll_wait(r->epoll_fd, events, REACTOR_MAX_EVENTS, -1);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("epoll_wait failed");
+      return;
+    }
+
+    for (int i = 0; i < n; i++) {
+      reactor_handler *h = (reactor_handler *)events[i].data.ptr;
+
+      switch (h->type) {
+      case REACTOR_STREAM:
+        epoll_stream_on_event(r, (reactor_stream *)h, events[i].events);
+        break;
+      case REACTOR_LISTENER:
+        epoll_accept(r, (reactor_listener *)h);
+        break;
+      case REACTOR_WAKEUP:
+        if (read(r->wakeup.fd, &r->wakeup_value, sizeof(r->wakeup_value)) <
+                0 &&
+            errno != EAGAIN) {
+          perror("reactor wakeup read failed");
+        }
+        reactor_drain_mailbox(r);
+        break;
+      }
+    }
+
+    // Everything queued during the round leaves in one write per stream
+    epoll_flush_dirty(r);
+  }
+}
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+int reactor_init(reactor *r, int id, reactor_engine engine) {
+  r->id = id;
+  r->engine = engine;
+  r->epoll_fd = -1;
+  r->uring = NULL;
+  r->dirty = NULL;
+  r->backpressure.high_watermark = REACTOR_HIGH_WATERMARK;
+  r->backpressure.low_watermark = REACTOR_LOW_WATERMARK;
+  r->backpressure.policy = REACTOR_DROP_OLDEST;
+  atomic_init(&r->metrics.queued_bytes, 0);
+  atomic_init(&r->metrics.congestions, 0);
+  atomic_init(&r->metrics.dropped, 0);
+  atomic_init(&r->metrics.disconnections, 0);
+  atomic_init(&r->metrics.read_pauses, 0);
+  atomic_init(&r->mailbox, NULL);
+  atomic_init(&r->wakeup_pending, 0);
+
+  r->wakeup.type = REACTOR_WAKEUP;
+  r->wakeup.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (r->wakeup.fd < 0) {
+    perror("eventfd failed");
+    return -1;
+  }
+
+  if (engine == REACTOR_IO_URING) {
+    if (reactor_uring_init(r) < 0) {
+      close(r->wakeup.fd);
+      return -1;
+    }
+    return 0;
+  }
+
+  r->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (r->epoll_fd < 0) {
+    perror("epoll_create1 failed");
+    close(r->wakeup.fd);
+    return -1;
+  }
+
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.ptr = &r->wakeup;
+  if (epoll_ctl(r->epoll_fd, EPOLL_CTL_ADD, r->wakeup.fd, &ev) < 0) {
+    perror("epoll_ctl failed");
+    close(r->epoll_fd);
+    close(r->wakeup.fd);
+    return -1;
+  }
+
+  return 0;
+}
+
+void reactor_destroy(reactor *r) {
+  if (r->engine == REACTOR_IO_URING) {
+    reactor_uring_destroy(r);
+  } else if (r->epoll_fd >= 0) {
+    close(r->epoll_fd);
+    r->epoll_fd = -1;
+  }
+
+  close(r->wakeup.fd);
+}
+
+// Clients accepted on a listener stay on the reactor the listener was added to
+int reactor_add_listener(reactor *r, reactor_listener *l) {
+  l->handler.type = REACTOR_LISTENER;
+
+  if (r->engine == REACTOR_IO_URING) {
+    return reactor_uring_add_listener(r, l);
+  }
+
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.ptr = l;
+  return epoll_ctl(r->epoll_fd, EPOLL_CTL_ADD, l->handler.fd, &ev);
+}
+
+// The stream starts with one reference, dropped by the reactor once closed
+int reactor_add_stream(reactor *r, reactor_stream *s) {
+  s->handler.type = REACTOR_STREAM;
+  s->owner = r;
+  atomic_init(&s->refs, 1);
+  s->closing = 0;
+  s->closed = 0;
+  s->failed = 0;
+  s->read_paused = 0;
+  s->read_held = 0;
+  s->dirty = 0;
+  s->dirty_next = NULL;
+  s->pending_ops = 0;
+  s->recv_armed = 0;
+  s->cancel_sent = 0;
+  s->sends_in_flight = 0;
+  s->sends_batch = 0;
+  s->out_head = 0;
+  s->out_count = 0;
+  s->out_offset = 0;
+  s->out_bytes = 0;
+
+  // Output is already coalesced once per round: Nagle would only hold the
+  // next round back until the peer's delayed ACK
+  int on = 1;
+  setsockopt(s->handler.fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+  if (r->engine == REACTOR_IO_URING) {
+    return reactor_uring_add_stream(r, s);
+  }
+
+  struct epoll_event ev;
+  ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+  ev.data.ptr = s;
+  return epoll_ctl(r->epoll_fd, EPOLL_CTL_ADD, s->handler.fd, &ev);
+}
+
+// Queue a buffer on a stream owned by r, it's sent at the end of the current
+// reactor round, or later when the socket becomes writable again. Returns -1
+// if the stream is broken or the buffer was refused by the backpressure
+// policy.
+int reactor_stream_write_buffer(reactor *r, reactor_stream *s,
+                                reactor_buffer *b) {
+  if (s->closed || s->failed) {
+    return -1;
+  }
+
+  if (s->out_count == REACTOR_MAX_QUEUED ||
+      s->out_bytes + b->len > r->backpressure.high_watermark) {
+    if (stream_on_congestion(r, s, b) < 0) {
+      return -1;
+    }
+  }
+
+  stream_queue_push(s, b);
+
+  stream_mark_dirty(r, s);
+  return 0;
+}
+
+int reactor_stream_write(reactor *r, reactor_stream *s, const char *data,
+                         size_t len) {
+  reactor_buffer *b = reactor_buffer_new(data, len);
+  if (b == NULL) {
+    return -1;
+  }
+
+  int res = reactor_stream_write_buffer(r, s, b);
+  reactor_buffer_unref(b);
+  return res;
+}
+
+// Send a buffer from any thread. The caller must make sure the stream is
+// alive during the call (holding a reference or a lock its owner needs to
+// forget it); other reactors hand the buffer over through the owner's mailbox.
+int reactor_stream_send(reactor_stream *s, reactor_buffer *b) {
+  if (current_reactor == s->owner) {
+    return reactor_stream_write_buffer(s->owner, s, b);
+  }
+  return reactor_post(s->owner, s, b);
+}
+
+// Close the stream once everything queued so far has been sent. Must be
+// called on the owning reactor, on_close follows later.
+void reactor_stream_close(reactor *r, reactor_stream *s) {
+  s->closing = 1;
+  stream_mark_dirty(r, s);
+}
+
+// A held stream is paused like one over its watermark, and reads again only
+// once neither holds it back
+void reactor_stream_hold_reading(reactor *r, reactor_stream *s) {
+  s->read_held = 1;
+  if (!s->read_paused) {
+    s->read_paused = 1;
+    atomic_fetch_add_explicit(&r->metrics.read_pauses, 1,
+                              memory_order_relaxed);
+  }
+}
+
+void reactor_stream_release_reading(reactor *r, reactor_stream *s) {
+  if (!s->read_held) {
+    return;
+  }
+
+  s->read_held = 0;
+  if (s->closing || !reactor_stream_resume_reading(r, s)) {
+    return;
+  }
+
+  if (r->engine == REACTOR_IO_URING) {
+    reactor_uring_read_again(r, s);
+  } else {
+    // Edge-triggered: what's waiting in the socket gets no new edge
+    epoll_stream_on_event(r, s, EPOLLIN);
+  }
+}
+
+void *reactor_run(void *arg) {
+  reactor *r = (reactor *)arg;
+  current_reactor = r;
+
+  if (r->engine == REACTOR_IO_URING) {
+    reactor_uring_run(r);
+  } else {
+    epoll_run(r);
+  }
+
+  return NULL;
+}
+
+int reactor_start(reactor *r) {
+  return pthread_create(&r->thread, NULL, reactor_run, r);
+}
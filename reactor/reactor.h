@@ -0,0 +1,204 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define REACTOR_MAX_EVENTS 64
+#define REACTOR_RECVBUFSIZE 4096
+#define REACTOR_MAX_QUEUED 256 // buffers waiting to be sent, per stream
+#define REACTOR_MAX_IOV 16     // buffers written by one sendmsg
+
+// Default bytes queued on a stream before it counts as a slow consumer, and
+// how far dropping brings it back down
+#define REACTOR_HIGH_WATERMARK (64 * 1024)
+#define REACTOR_LOW_WATERMARK (16 * 1024)
+
+// How a reactor waits for and performs socket I/O
+typedef enum {
+  REACTOR_EPOLL,    // readiness with epoll, then recv/send
+  REACTOR_IO_URING, // completions with io_uring, no syscall per recv/send
+} reactor_engine;
+
+// What happens to a stream whose output queue reaches the high watermark
+typedef enum {
+  REACTOR_DROP_OLDEST, // drop the oldest unsent buffers down to the low mark
+  REACTOR_DISCONNECT,  // give up on the stream and close it
+} reactor_slow_policy;
+
+typedef struct {
+  size_t high_watermark;
+  size_t low_watermark;
+  reactor_slow_policy policy;
+} reactor_backpressure;
+
+// Counters of one reactor, written by its thread, readable from any thread
+typedef struct {
+  atomic_ulong queued_bytes;   // output queued on all its streams right now
+  atomic_ulong congestions;    // times a stream hit the high watermark
+  atomic_ulong dropped;        // buffers dropped, or never handed over
+  atomic_ulong disconnections; // streams closed by REACTOR_DISCONNECT
+  atomic_ulong read_pauses;    // times a stream stopped reading its socket
+} reactor_metrics;
+
+typedef struct reactor reactor;
+typedef struct reactor_listener reactor_listener;
+typedef struct reactor_stream reactor_stream;
+typedef struct reactor_task reactor_task;
+
+// Immutable, reference counted bytes to send. The same buffer can be queued
+// on any number of streams, so a message is formatted once and every
+// recipient's socket is written straight from it.
+typedef struct {
+  atomic_int refs;
+  size_t len;
+  char data[];
+} reactor_buffer;
+
+// New client accepted on a listener, fd is already non-blocking
+typedef void (*reactor_accept_callback)(reactor *r, reactor_listener *l,
+                                        int fd);
+
+// Bytes received on a stream, data is only valid during the call
+typedef void (*reactor_data_callback)(reactor *r, reactor_stream *s,
+                                      char *data, size_t len);
+
+// on_close: the stream is closed, nothing may take new references to it.
+// on_release: the last reference is gone, this is where its memory can be
+// freed. Both are called exactly once, on the owning reactor.
+typedef void (*reactor_close_callback)(reactor *r, reactor_stream *s);
+
+typedef enum {
+  REACTOR_LISTENER,
+  REACTOR_STREAM,
+  REACTOR_WAKEUP,
+} reactor_handler_type;
+
+typedef struct {
+  int fd;
+  reactor_handler_type type;
+} reactor_handler;
+
+// Embed as the first member of the owning struct
+struct reactor_listener {
+  reactor_handler handler;
+  reactor_accept_callback on_accept;
+};
+
+// Work handed to a reactor from any thread, run on the reactor's thread.
+// Embed it in the struct carrying the work, run owns it from then on.
+typedef void (*reactor_task_callback)(reactor *r, reactor_task *t);
+
+struct reactor_task {
+  reactor_task *next;
+  reactor_task_callback run;
+};
+
+// Embed as the first member of the owning struct. A stream is owned by the
+// reactor it was added to and only that reactor's thread reads, writes or
+// closes it; other threads hand it buffers with reactor_stream_send.
+struct reactor_stream {
+  reactor_handler handler;
+  reactor_data_callback on_data;
+  reactor_close_callback on_close;
+  reactor_close_callback on_release;
+  reactor *owner;
+  atomic_int refs;
+  // Posted to the owner when the last reference is dropped on another
+  // thread: part of the stream, so the release can't fail to be delivered
+  reactor_task release;
+  int closing;
+  int closed;
+  int failed;
+
+  // Reading stopped until the peer takes its output: a client pipelining
+  // faster than it reads the answers is slowed down instead of losing them
+  int read_paused;
+  // Also stopped by its owner, until it catches up with what was read
+  int read_held;
+
+  // Queued output waiting for the end of the reactor round to be flushed
+  int dirty;
+  reactor_stream *dirty_next;
+
+  // io_uring only: operations the kernel still holds a reference to
+  int pending_ops;
+  int recv_armed;
+  int cancel_sent;
+  int sends_in_flight;
+  int sends_batch;
+
+  // Ring of buffers not sent yet, the first one may be partially sent (epoll)
+  // or the first sends_batch ones may be in flight (io_uring)
+  reactor_buffer *out[REACTOR_MAX_QUEUED];
+  int out_head;
+  int out_count;
+  size_t out_offset;
+  size_t out_bytes;
+};
+
+struct reactor_uring;
+
+struct reactor {
+  int id;
+  reactor_engine engine;
+  int epoll_fd;
+  struct reactor_uring *uring;
+  pthread_t thread;
+
+  // Tasks posted by other threads, drained when the wakeup eventfd fires
+  reactor_handler wakeup;
+  uint64_t wakeup_value;
+  _Atomic(reactor_task *) mailbox;
+  atomic_int wakeup_pending;
+
+  // Streams with output queued during this round
+  reactor_stream *dirty;
+
+  reactor_backpressure backpressure;
+  reactor_metrics metrics;
+};
+
+int reactor_init(reactor *r, int id, reactor_engine engine);
+void reactor_destroy(reactor *r);
+
+int reactor_add_listener(reactor *r, reactor_listener *l);
+int reactor_add_stream(reactor *r, reactor_stream *s);
+
+reactor *reactor_current();
+
+reactor_buffer *reactor_buffer_new(const char *data, size_t len);
+void reactor_buffer_ref(reactor_buffer *b);
+void reactor_buffer_unref(reactor_buffer *b);
+
+int reactor_stream_write(reactor *r, reactor_stream *s, const char *data,
+                         size_t len);
+int reactor_stream_write_buffer(reactor *r, reactor_stream *s,
+                                reactor_buffer *b);
+// Returns -1 like reactor_stream_write_buffer, or when the buffer couldn't
+// be handed over to the owner (out of memory, counted as dropped)
+int reactor_stream_send(reactor_stream *s, reactor_buffer *b);
+void reactor_stream_close(reactor *r, reactor_stream *s);
+
+// The owner of a stream stops reading it while what was read still waits to
+// be handled, and reads again once it caught up: the rest waits in the
+// socket, then in the peer. On the stream's reactor only.
+void reactor_stream_hold_reading(reactor *r, reactor_stream *s);
+void reactor_stream_release_reading(reactor *r, reactor_stream *s);
+
+void reactor_post_task(reactor *r, reactor_task *t);
+
+void reactor_stream_ref(reactor_stream *s);
+void reactor_stream_unref(reactor_stream *s);
+
+int reactor_start(reactor *r);
+void *reactor_run(void *arg);
+
+const char *reactor_engine_name(reactor_engine engine);
+int reactor_engine_from_name(const char *name, reactor_engine *engine);
+
+int set_nonblocking(int fd);
+
+#endif // REACTOR_H
@@ -0,0 +1,494 @@
+#include "reactor_uring.h"
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Talks to the kernel directly through the io_uring syscalls, so the server
+// doesn't need liburing to build.
+//
+// Accepts are multishot: armed once, they keep producing completions.
+// Receives are armed again after each completion instead, so a stream whose
+// answers pile up can simply stop reading. They pick their memory from a
+// provided buffer ring, so no buffer is pinned by idle clients. The queued output of a stream is sent as
+// a chain of linked sends, one per queued buffer, so messages leave in order
+// and a whole batch of them costs a single io_uring_enter. The wakeup eventfd
+// is read through the ring too, so posts from other reactors complete like
+// any other operation.
+
+#define URING_ENTRIES 256
+#define URING_CQ_ENTRIES (URING_ENTRIES * 8)
+#define URING_BUFFER_COUNT 256 // must be a power of 2
+#define URING_BUFFER_GROUP 0
+
+// Low bits of the user_data say which operation completed, the rest is the
+// pointer to the listener or the stream
+#define URING_OP_MASK 7ULL
+
+enum {
+  URING_OP_IGNORE = 0,
+  URING_OP_ACCEPT,
+  URING_OP_RECV,
+  URING_OP_SEND,
+  URING_OP_WAKEUP,
+};
+
+struct reactor_uring {
+  int ring_fd;
+  unsigned sq_entries;
+
+  void *ring;
+  size_t ring_size;
+  unsigned *sq_head;
+  unsigned *sq_tail;
+  unsigned *sq_mask;
+  unsigned *cq_head;
+  unsigned *cq_tail;
+  unsigned *cq_mask;
+  struct io_uring_cqe *cqes;
+
+  struct io_uring_sqe *sqes;
+  size_t sqes_size;
+  unsigned sqe_tail;
+
+  struct io_uring_buf_ring *buf_ring;
+  size_t buf_ring_size;
+  unsigned short buf_tail;
+  char *buffers;
+};
+
+static int uring_setup(unsigned entries, struct io_uring_params *p) {
+  return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                       unsigned flags) {
+  return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                      NULL, 0);
+}
+
+static int uring_register(int fd, unsigned opcode, void *arg,
+                          unsigned nr_args) {
+  return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+// Hand every prepared SQE to the kernel, optionally waiting for a completion
+static int uring_submit(struct reactor_uring *u, unsigned wait_for) {
+  __atomic_store_n(u->sq_tail, u->sqe_tail, __ATOMIC_RELEASE);
+  unsigned to_submit =
+      u->sqe_tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+
+  return uring_enter(u->ring_fd, to_submit, wait_for,
+                     wait_for ? IORING_ENTER_GETEVENTS : 0);
+}
+
+// Make sure count SQEs can be prepared without a submit in between, a link
+// chain must reach the kernel in one piece
+static void uring_reserve(struct reactor_uring *u, unsigned count) {
+  unsigned used = u->sqe_tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+  if (used + count > u->sq_entries) {
+    uring_submit(u, 0);
+  }
+}
+
+static struct io_uring_sqe *uring_get_sqe(struct reactor_uring *u) {
+  uring_reserve(u, 1);
+
+  struct io_uring_sqe *sqe = &u->sqes[u->sqe_tail & *u->sq_mask];
+  u->sqe_tail++;
+  memset(sqe, 0, sizeof(*sqe));
+  return sqe;
+}
+
+static void uring_recycle_buffer(struct reactor_uring *u, unsigned short bid) {
+  struct io_uring_buf *buf =
+      &u->buf_ring->bufs[u->buf_tail & (URING_BUFFER_COUNT - 1)];
+  buf->addr = (uint64_t)(uintptr_t)(u->buffers + bid * REACTOR_RECVBUFSIZE);
+  buf->len = REACTOR_RECVBUFSIZE;
+  buf->bid = bid;
+
+  u->buf_tail++;
+  __atomic_store_n(&u->buf_ring->tail, u->buf_tail, __ATOMIC_RELEASE);
+}
+
+static int uring_setup_buffers(struct reactor_uring *u) {
+  u->buf_ring_size = URING_BUFFER_COUNT * sizeof(struct io_uring_buf);
+  u->buf_ring = mmap(NULL, u->buf_ring_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (u->buf_ring == MAP_FAILED) {
+    u->buf_ring = NULL;
+    return -1;
+  }
+
+  u->buffers = malloc((size_t)URING_BUFFER_COUNT * REACTOR_RECVBUFSIZE);
+  if (u->buffers == NULL) {
+    return -1;
+  }
+
+  struct io_uring_buf_reg reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = (uint64_t)(uintptr_t)u->buf_ring;
+  reg.ring_entries = URING_BUFFER_COUNT;
+  reg.bgid = URING_BUFFER_GROUP;
+
+  if (uring_register(u->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+    return -1;
+  }
+
+  u->buf_tail = 0;
+  for (unsigned short bid = 0; bid < URING_BUFFER_COUNT; bid++) {
+    uring_recycle_buffer(u, bid);
+  }
+
+  return 0;
+}
+
+static void uring_arm_wakeup(reactor *r) {
+  struct io_uring_sqe *sqe = uring_get_sqe(r->uring);
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = r->wakeup.fd;
+  sqe->addr = (uint64_t)(uintptr_t)&r->wakeup_value;
+  sqe->len = sizeof(r->wakeup_value);
+  sqe->user_data = (uint64_t)(uintptr_t)r | URING_OP_WAKEUP;
+}
+
+int reactor_uring_init(reactor *r) {
+  struct reactor_uring *u = calloc(1, sizeof(struct reactor_uring));
+  if (u == NULL) {
+    return -1;
+  }
+  u->ring_fd = -1;
+  r->uring = u;
+
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  p.flags = IORING_SETUP_CQSIZE;
+  p.cq_entries = URING_CQ_ENTRIES;
+
+  u->ring_fd = uring_setup(URING_ENTRIES, &p);
+  if (u->ring_fd < 0) {
+    perror("io_uring_setup failed");
+    reactor_uring_destroy(r);
+    return -1;
+  }
+
+  if (!(p.features & IORING_FEAT_SINGLE_MMAP) ||
+      !(p.features & IORING_FEAT_NODROP)) {
+    fprintf(stderr, "io_uring: kernel is too old\n");
+    reactor_uring_destroy(r);
+    return -1;
+  }
+
+  size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  u->ring_size = sq_size > cq_size ? sq_size : cq_size;
+
+  u->ring = mmap(NULL, u->ring_size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, u->ring_fd, IORING_OFF_SQ_RING);
+  if (u->ring == MAP_FAILED) {
+    u->ring = NULL;
+    perror("io_uring mmap failed");
+    reactor_uring_destroy(r);
+    return -1;
+  }
+
+  u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+  u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, u->ring_fd, IORING_OFF_SQES);
+  if (u->sqes == MAP_FAILED) {
+    u->sqes = NULL;
+    perror("io_uring mmap failed");
+    reactor_uring_destroy(r);
+    return -1;
+  }
+
+  char *ring = u->ring;
+  u->sq_entries = p.sq_entries;
+  u->sq_head = (unsigned *)(ring + p.sq_off.head);
+  u->sq_tail = (unsigned *)(ring + p.sq_off.tail);
+  u->sq_mask = (unsigned *)(ring + p.sq_off.ring_mask);
+  u->cq_head = (unsigned *)(ring + p.cq_off.head);
+  u->cq_tail = (unsigned *)(ring + p.cq_off.tail);
+  u->cq_mask = (unsigned *)(ring + p.cq_off.ring_mask);
+  u->cqes = (struct io_uring_cqe *)(ring + p.cq_off.cqes);
+  u->sqe_tail = *u->sq_tail;
+
+  // SQE slots are always used in ring order
+  unsigned *sq_array = (unsigned *)(ring + p.sq_off.array);
+  for (unsigned i = 0; i < p.sq_entries; i++) {
+    sq_array[i] = i;
+  }
+
+  if (uring_setup_buffers(u) < 0) {
+    perror("io_uring provided buffers failed");
+    reactor_uring_destroy(r);
+    return -1;
+  }
+
+  uring_arm_wakeup(r);
+  return 0;
+}
+
+void reactor_uring_destroy(reactor *r) {
+  struct reactor_uring *u = r->uring;
+  if (u == NULL) {
+    return;
+  }
+
+  if (u->sqes != NULL) {
+    munmap(u->sqes, u->sqes_size);
+  }
+  if (u->ring != NULL) {
+    munmap(u->ring, u->ring_size);
+  }
+  if (u->ring_fd >= 0) {
+    close(u->ring_fd);
+  }
+  if (u->buf_ring != NULL) {
+    munmap(u->buf_ring, u->buf_ring_size);
+  }
+  free(u->buffers);
+  free(u);
+  r->uring = NULL;
+}
+
+static void uring_arm_accept(reactor *r, reactor_listener *l) {
+  struct io_uring_sqe *sqe = uring_get_sqe(r->uring);
+  sqe->opcode = IORING_OP_ACCEPT;
+  sqe->fd = l->handler.fd;
+  sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+  sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+  sqe->user_data = (uint64_t)(uintptr_t)l | URING_OP_ACCEPT;
+}
+
+static void uring_arm_recv(reactor *r, reactor_stream *s) {
+  struct io_uring_sqe *sqe = uring_get_sqe(r->uring);
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = s->handler.fd;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = URING_BUFFER_GROUP;
+  sqe->user_data = (uint64_t)(uintptr_t)s | URING_OP_RECV;
+
+  s->recv_armed = 1;
+  s->pending_ops++;
+}
+
+static void uring_cancel_recv(reactor *r, reactor_stream *s) {
+  struct io_uring_sqe *sqe = uring_get_sqe(r->uring);
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->addr = (uint64_t)(uintptr_t)s | URING_OP_RECV;
+  sqe->user_data = URING_OP_IGNORE;
+
+  s->cancel_sent = 1;
+}
+
+int reactor_uring_add_listener(reactor *r, reactor_listener *l) {
+  uring_arm_accept(r, l);
+  return 0;
+}
+
+int reactor_uring_add_stream(reactor *r, reactor_stream *s) {
+  uring_arm_recv(r, s);
+  return 0;
+}
+
+// Send the queue as one chain of linked sends. MSG_WAITALL makes a short send
+// retry inside the kernel, so a send either completes fully or fails, and a
+// failure cancels the rest of the chain.
+static void uring_stream_flush(reactor *r, reactor_stream *s) {
+  if (s->sends_in_flight > 0 || s->out_count == 0 || s->failed) {
+    return;
+  }
+
+  uring_reserve(r->uring, s->out_count);
+
+  for (int i = 0; i < s->out_count; i++) {
+    reactor_buffer *b = s->out[(s->out_head + i) % REACTOR_MAX_QUEUED];
+
+    struct io_uring_sqe *sqe = uring_get_sqe(r->uring);
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = s->handler.fd;
+    sqe->addr = (uint64_t)(uintptr_t)b->data;
+    sqe->len = b->len;
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+    sqe->user_data = (uint64_t)(uintptr_t)s | URING_OP_SEND;
+    if (i < s->out_count - 1) {
+      sqe->flags = IOSQE_IO_LINK;
+    }
+  }
+
+  s->sends_in_flight = s->out_count;
+  s->sends_batch = s->out_count;
+  s->pending_ops += s->out_count;
+}
+
+// Move a stream forward after one of its completions: send what was queued
+// meanwhile, and once it's closing and drained, cancel the receive and finish
+// it when the kernel gives back the last operation. The stream may be freed
+// on return unless the caller holds a reference.
+static void uring_stream_progress(reactor *r, reactor_stream *s) {
+  if (s->closed) {
+    return;
+  }
+
+  uring_stream_flush(r, s);
+
+  if (!s->closing || s->sends_in_flight > 0 ||
+      (s->out_count > 0 && !s->failed)) {
+    return;
+  }
+
+  if (s->recv_armed && !s->cancel_sent) {
+    uring_cancel_recv(r, s);
+  }
+
+  if (s->pending_ops == 0) {
+    reactor_stream_finish(r, s);
+  }
+}
+
+static void uring_on_recv(reactor *r, reactor_stream *s, int res,
+                          unsigned flags) {
+  struct reactor_uring *u = r->uring;
+
+  s->recv_armed = 0;
+  s->pending_ops--;
+
+  if (res > 0) {
+    unsigned short bid = flags >> IORING_CQE_BUFFER_SHIFT;
+    if (!s->closing) {
+      s->on_data(r, s, u->buffers + bid * REACTOR_RECVBUFSIZE, res);
+    }
+    uring_recycle_buffer(u, bid);
+
+    // The answers pile up faster than the peer takes them: the rest waits in
+    // the socket until the sends complete
+    reactor_stream_pause_reading(r, s);
+  } else if (res == -ENOBUFS) {
+    // Every buffer is in use, rearming below retries once some come back
+  } else if (res != -ECANCELED) {
+    // Peer closed or the connection broke, nobody will read the output
+    s->failed = 1;
+    s->closing = 1;
+    if (s->sends_in_flight == 0) {
+      reactor_stream_discard(s);
+    }
+  }
+
+  if (!s->recv_armed && !s->closing && !s->read_paused) {
+    uring_arm_recv(r, s);
+  }
+
+  uring_stream_progress(r, s);
+}
+
+// Reading was resumed by the stream's owner rather than by a completion
+void reactor_uring_read_again(reactor *r, reactor_stream *s) {
+  if (!s->recv_armed && !s->closing && !s->read_paused) {
+    uring_arm_recv(r, s);
+  }
+}
+
+static void uring_on_send(reactor *r, reactor_stream *s, int res) {
+  s->sends_in_flight--;
+  s->pending_ops--;
+
+  if (res < 0) {
+    s->failed = 1;
+    s->closing = 1;
+  }
+
+  if (s->sends_in_flight == 0) {
+    if (s->failed) {
+      reactor_stream_discard(s);
+    } else {
+      reactor_stream_pop(s, s->sends_batch);
+    }
+    s->sends_batch = 0;
+
+    if (reactor_stream_resume_reading(r, s) && !s->recv_armed &&
+        !s->closing) {
+      uring_arm_recv(r, s);
+    }
+  }
+
+  uring_stream_progress(r, s);
+}
+
+// Streams written during the round get their sends prepared before the next
+// submit, so they ride along with it
+void reactor_uring_flush_dirty(reactor *r) {
+  while (r->dirty != NULL) {
+    reactor_stream *s = r->dirty;
+    r->dirty = s->dirty_next;
+    s->dirty = 0;
+
+    uring_stream_progress(r, s);
+    reactor_stream_unref(s);
+  }
+}
+
+static void uring_on_accept(reactor *r, reactor_listener *l, int res,
+                            unsigned flags) {
+  if (res >= 0) {
+    l->on_accept(r, l, res);
+  } else if (res != -EINTR && res != -EAGAIN && res != -ECONNABORTED) {
+    fprintf(stderr, "accept failed: %s\n", strerror(-res));
+  }
+
+  if (!(flags & IORING_CQE_F_MORE)) {
+    uring_arm_accept(r, l);
+  }
+}
+
+void reactor_uring_run(reactor *r) {
+  struct reactor_uring *u = r->uring;
+
+  while (1) {
+    // Submits everything prepared since the last round and waits, this is
+    // the only syscall of the loop
+    if (uring_submit(u, 1) < 0 && errno != EINTR && errno != EAGAIN &&
+        errno != EBUSY) {
+      perror("io_uring_enter failed");
+      return;
+    }
+
+    unsigned head = *u->cq_head;
+    while (head != __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE)) {
+      struct io_uring_cqe *cqe = &u->cqes[head & *u->cq_mask];
+      uint64_t user_data = cqe->user_data;
+      int res = cqe->res;
+      unsigned flags = cqe->flags;
+
+      head++;
+      __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+
+      void *ptr = (void *)(uintptr_t)(user_data & ~URING_OP_MASK);
+      switch (user_data & URING_OP_MASK) {
+      case URING_OP_ACCEPT:
+        uring_on_accept(r, (reactor_listener *)ptr, res, flags);
+        break;
+      case URING_OP_RECV:
+        uring_on_recv(r, (reactor_stream *)ptr, res, flags);
+        break;
+      case URING_OP_SEND:
+        uring_on_send(r, (reactor_stream *)ptr, res);
+        break;
+      case URING_OP_WAKEUP:
+        reactor_drain_mailbox(r);
+        uring_arm_wakeup(r);
+        break;
+      default:
+        break;
+      }
+    }
+
+    reactor_uring_flush_dirty(r);
+  }
+}
@@ -0,0 +1,26 @@
+#ifndef REACTOR_URING_H
+#define REACTOR_URING_H
+
+#include "reactor.h"
+
+// io_uring engine of the reactor, only used by reactor.c
+
+int reactor_uring_init(reactor *r);
+void reactor_uring_destroy(reactor *r);
+
+int reactor_uring_add_listener(reactor *r, reactor_listener *l);
+int reactor_uring_add_stream(reactor *r, reactor_stream *s);
+
+void reactor_uring_run(reactor *r);
+
+void reactor_uring_flush_dirty(reactor *r);
+void reactor_uring_read_again(reactor *r, reactor_stream *s);
+
+void reactor_stream_pop(reactor_stream *s, int count);
+void reactor_stream_discard(reactor_stream *s);
+void reactor_stream_finish(reactor *r, reactor_stream *s);
+void reactor_drain_mailbox(reactor *r);
+int reactor_stream_pause_reading(reactor *r, reactor_stream *s);
+int reactor_stream_resume_reading(reactor *r, reactor_stream *s);
+
+#endif // REACTOR_URING_H
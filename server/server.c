@@ -1,135 +1,673 @@
 // linux socket explanation: https://www.youtube.com/watch?v=XXfdzwEsxFk
 
+#define _GNU_SOURCE
+
 #include <arpa/inet.h>
 #include <ctype.h>
 #include <errno.h>
 #include <netinet/in.h>
 #include <pthread.h>
+#include <signal.h>
 #include <stdatomic.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
-#include "../client_queue/client_queue.h"
+#include "../cache/cache.h"
 #include "../hash_table/hash_table.h"
+#include "../hash_table/hash_table_concurrent.h"
+#include "../phash/phash.h"
+#include "../phrase/phrase.h"
+#include "../protocol/protocol.h"
+#include "../rcu/rcu.h"
+#include "../reactor/reactor.h"
+#include "../tokenizer/tokenizer.h"
+#include "../worker_pool/worker_pool.h"
 
-#define PORT_ENGLISH_TO_ITALIAN 8080
-#define PORT_ITALIAN_TO_ENGLISH 6969
-#define BUFSIZE 1024
 #define MAX_LENGTH 1000
-#define MAX_USERS_PER_ROOM 1
-#define MAX_CLIENTS 50
-
+#define MAX_ROOMS 64
+#define MAX_ROOM_NAME_LENGTH 64
+#define MAX_PATH_LENGTH 256
+#define ROOMS_FILE "./server/rooms.txt"
+#define CORRECTIONS_FILE "./server/corrections.txt"
+#define TRANSLATION_JOB_SIZE (16 * 1024)
+// Jobs waiting per connection before its reads stop, and what reading again
+// waits for: a client pipelining faster than the workers translate queues
+// at most this much in the server, the rest waits in the socket
+#define CONNECTION_MAX_JOBS 8
+#define CONNECTION_RESUME_JOBS 2
+#define TRANSLATION_CACHE_SIZE (4 * 1024 * 1024)
+// Greetings and short replies come back again and again, long messages
+// rarely do and would only push them out
+#define TRANSLATION_CACHE_MAX_MESSAGE 256
+
+// Corrections of one translation direction, made while the server runs. A
+// corrected phrase is also in a trie, replaced as a whole by a copy with the
+// next one and freed after a grace period.
+typedef struct {
+  cht_hash_table *words;
+  _Atomic(phrase_dictionary *) phrases; // NULL until a phrase is corrected
+} dictionary_corrections;
+
+// One translation direction: perfect hash tables built by vocab_compiler,
+// compiled into the server or mapped from a binary dictionary, or a hash
+// table built from the text file at startup. Corrections made while the
+// server runs are looked up first. Keys of more than one word are also in a
+// trie of phrases, matched before single words.
+typedef struct {
+  const phash_table *compiled;
+  ht_hash_table *table;
+  dictionary_corrections *corrections;
+  phrase_dictionary *phrases; // NULL when there are none
+} dictionary;
+
+// Both translation directions of one vocabulary file as loaded once, never
+// changed: a reload loads a whole new snapshot
 typedef struct {
-  ht_hash_table *english_to_italian;
-  ht_hash_table *italian_to_english;
+  phash_file file; // mapped when the file is a binary dictionary
+  dictionary source_to_target;
+  dictionary target_to_source;
+} vocab_snapshot;
+
+// The snapshot in use is published through an RCU pointer: translations load
+// it inside a read section, without a lock, while a reload swaps it. The
+// corrections belong to the vocabulary and outlive reloads, every snapshot
+// refers to them. The generation goes up after every reload and correction,
+// cached translations of an older one are never used again.
+typedef struct {
+  char path[MAX_PATH_LENGTH];
+  int id;
+  _Atomic(vocab_snapshot *) current;
+  dictionary_corrections source_to_target_corrections;
+  dictionary_corrections target_to_source_corrections;
+  atomic_uint generation;
 } vocab;
 
-int server_fd_english_to_italian, server_fd_italian_to_english;
-
-atomic_int waiting_english_to_italian_clients = 0;
-atomic_int waiting_italian_to_english_clients = 0;
-
-pthread_mutex_t waiting_clients_english_to_italian_mutex =
-    PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t waiting_clients_italian_to_english_mutex =
-    PTHREAD_MUTEX_INITIALIZER;
+typedef struct connection connection;
 
-client_queue *waiting_client_queue_english_to_italian;
-client_queue *waiting_client_queue_italian_to_english;
+// A chat room, every room is one line of the rooms file. All rooms are served
+// by the same reactors with the same code, a room is only data.
+typedef struct {
+  char name[MAX_ROOM_NAME_LENGTH];
+  int port;
+  int capacity;
+  vocab *vocab;
+  int reverse; // translates the second column of the vocabulary
+
+  // Members and the waiting queue are shared by every reactor
+  pthread_mutex_t mutex;
+  int member_count;
+  connection *members;
+  int waiting_count;
+  connection *waiting_head;
+  connection *waiting_tail;
+
+  // Time spent handing each batch of chat messages to every member,
+  // protected by the room mutex
+  unsigned long fanout_messages;
+  unsigned long fanout_count;
+  unsigned long long fanout_ns_total;
+  unsigned long long fanout_ns_max;
+} room;
+
+room rooms[MAX_ROOMS];
+int room_count = 0;
+
+vocab *vocabs[MAX_ROOMS];
+int vocab_count = 0;
 
 // Translation handling
 //
 // +++++++++++++++++++++++++++++++++++++++++++++++++++++++
 //
-// Create vocabulary hash tables for text file
-vocab *vocab_setup_from_txt() {
-  FILE *file = fopen("./server/vocab.txt", "r");
+// Most vocabularies have no phrase at all, their words skip the trie
+void dictionary_drop_empty_phrases(dictionary *d) {
+  if (d->phrases != NULL && d->phrases->node_count == 1) {
+    phrase_dictionary_free(d->phrases);
+    d->phrases = NULL;
+  }
+}
+
+// The phrases vocab_compiler listed, into a trie. Only the list is read, the
+// rest of the table stays as it is, mapped or in the binary. *out is NULL
+// when there are none, -1 when out of memory.
+int phrases_from_compiled(const phash_table *t, phrase_dictionary **out) {
+  *out = NULL;
+  if (t->phrase_count == 0) {
+    return 0;
+  }
+
+  phrase_dictionary *d = phrase_dictionary_new();
+  if (d == NULL) {
+    return -1;
+  }
+  for (uint32_t i = 0; i < t->phrase_count; i++) {
+    // A mapped list is checked like the entries phash_search reads
+    if (t->phrases[i] >= t->count) {
+      continue;
+    }
+    const phash_entry *e = &t->entries[t->phrases[i]];
+    if (e->key < t->strings_size && e->value < t->strings_size &&
+        phrase_dictionary_add(d, t->strings + e->key,
+                              t->strings + e->value) < 0) {
+      phrase_dictionary_free(d);
+      return -1;
+    }
+  }
+
+  *out = d;
+  return 0;
+}
+
+void vocab_snapshot_free(vocab_snapshot *v) {
+  phash_file_close(&v->file);
+  ht_del_hash_table(v->source_to_target.table);
+  ht_del_hash_table(v->target_to_source.table);
+  phrase_dictionary_free(v->source_to_target.phrases);
+  phrase_dictionary_free(v->target_to_source.phrases);
+  free(v);
+}
+
+// Create vocabulary hash tables for text file, keys folded like
+// vocab_compiler does
+vocab_snapshot *vocab_snapshot_from_txt(const char *path) {
+  FILE *file = fopen(path, "r");
   if (file == NULL) {
-    perror("Error opening file: %s");
+    perror("Error opening file");
     return NULL;
   }
 
-  char line[MAX_LENGTH];
-  char *first_word, *second_word;
-
-  vocab *v = malloc(sizeof(vocab));
-  v->english_to_italian = ht_new();
-  v->italian_to_english = ht_new();
+  char line[MAX_LENGTH], key[MAX_LENGTH];
+  char *first_word, *second_word, *saveptr;
 
-  while (fgets(line, MAX_LENGTH, file) != NULL) {
+  // Out of memory, a reload keeps the snapshot in use: nothing half loaded
+  // is returned
+  vocab_snapshot *v = malloc(sizeof(vocab_snapshot));
+  if (v == NULL) {
+    perror("Failed to allocate vocabulary");
+    fclose(file);
+    return NULL;
+  }
+  v->file.map = NULL;
+  v->source_to_target.compiled = NULL;
+  v->source_to_target.table = ht_new();
+  v->source_to_target.corrections = NULL;
+  v->source_to_target.phrases = phrase_dictionary_new();
+  v->target_to_source.compiled = NULL;
+  v->target_to_source.table = ht_new();
+  v->target_to_source.corrections = NULL;
+  v->target_to_source.phrases = phrase_dictionary_new();
+  int failed = v->source_to_target.table == NULL ||
+               v->source_to_target.phrases == NULL ||
+               v->target_to_source.table == NULL ||
+               v->target_to_source.phrases == NULL;
+
+  while (!failed && fgets(line, MAX_LENGTH, file) != NULL) {
     line[strcspn(line, "\n")] = 0;
 
-    first_word = strtok(line, ",");
+    // Reentrant, a reload parses while the workers translate
+    first_word = strtok_r(line, ",", &saveptr);
     if (first_word != NULL) {
-      second_word = strtok(NULL, ",");
+      second_word = strtok_r(NULL, ",", &saveptr);
       if (second_word != NULL) {
-        ht_insert(v->english_to_italian, first_word, second_word);
-        ht_insert(v->italian_to_english, second_word, first_word);
+        ht_fold_key(key, first_word);
+        failed = ht_insert(v->source_to_target.table, key, second_word) < 0 ||
+                 phrase_dictionary_add(v->source_to_target.phrases, key,
+                                       second_word) < 0;
+        ht_fold_key(key, second_word);
+        failed |= ht_insert(v->target_to_source.table, key, first_word) < 0 ||
+                  phrase_dictionary_add(v->target_to_source.phrases, key,
+                                        first_word) < 0;
       }
     }
   }
 
   fclose(file);
+  if (failed) {
+    perror("Failed to allocate vocabulary");
+    vocab_snapshot_free(v);
+    return NULL;
+  }
+
+  // Most words of a message aren't in the vocabulary, the filters turn them
+  // away before the tables are probed. Without one a table is only slower.
+  if (ht_filter_build(v->source_to_target.table) < 0 ||
+      ht_filter_build(v->target_to_source.table) < 0) {
+    perror("Failed to allocate vocabulary filter");
+  }
+
+  dictionary_drop_empty_phrases(&v->source_to_target);
+  dictionary_drop_empty_phrases(&v->target_to_source);
+  return v;
+}
+
+// The tables vocab_compiler built from this file, unless the file changed
+// since (or was never compiled)
+const phash_vocab *vocab_find_compiled(const char *path) {
+  for (int i = 0; i < phash_vocab_count; i++) {
+    const phash_vocab *compiled = &phash_vocabs[i];
+    if (strcmp(compiled->path, path) != 0) {
+      continue;
+    }
 
+    struct stat st;
+    if (stat(path, &st) == 0 && (st.st_size != compiled->size ||
+                                 st.st_mtime != compiled->mtime)) {
+      printf("%s changed since it was compiled, reading it again\n", path);
+      return NULL;
+    }
+    return compiled;
+  }
+  return NULL;
+}
+
+// Nothing to parse or allocate, the tables are in the server binary
+vocab_snapshot *vocab_snapshot_from_compiled(const phash_vocab *compiled) {
+  vocab_snapshot *v = malloc(sizeof(vocab_snapshot));
+  if (v == NULL) {
+    return NULL;
+  }
+
+  v->file.map = NULL;
+  v->source_to_target.compiled = &compiled->source_to_target;
+  v->source_to_target.table = NULL;
+  v->source_to_target.corrections = NULL;
+  v->target_to_source.compiled = &compiled->target_to_source;
+  v->target_to_source.table = NULL;
+  v->target_to_source.corrections = NULL;
+  v->target_to_source.phrases = NULL;
+  if (phrases_from_compiled(&compiled->source_to_target,
+                            &v->source_to_target.phrases) < 0 ||
+      phrases_from_compiled(&compiled->target_to_source,
+                            &v->target_to_source.phrases) < 0) {
+    perror("Failed to allocate vocabulary phrases");
+    vocab_snapshot_free(v);
+    return NULL;
+  }
   return v;
 }
 
-void first_letter_uppercase(char *str) { str[0] = toupper(str[0]); }
+// Binary dictionary written by vocab_compiler -b: mapped, not read, so
+// startup doesn't depend on its size and servers on the same machine share
+// its pages. Returns 1 when the file is a text vocabulary instead.
+int vocab_snapshot_from_file(const char *path, vocab_snapshot **out) {
+  vocab_snapshot *v = malloc(sizeof(vocab_snapshot));
+  if (v == NULL) {
+    return -1;
+  }
+
+  int res = phash_file_open(path, &v->file);
+  if (res != 0) {
+    free(v);
+    return res;
+  }
+
+  v->source_to_target.compiled = &v->file.source_to_target;
+  v->source_to_target.table = NULL;
+  v->source_to_target.corrections = NULL;
+  v->target_to_source.compiled = &v->file.target_to_source;
+  v->target_to_source.table = NULL;
+  v->target_to_source.corrections = NULL;
+  v->target_to_source.phrases = NULL;
+  if (phrases_from_compiled(&v->file.source_to_target,
+                            &v->source_to_target.phrases) < 0 ||
+      phrases_from_compiled(&v->file.target_to_source,
+                            &v->target_to_source.phrases) < 0) {
+    perror("Failed to allocate vocabulary phrases");
+    vocab_snapshot_free(v);
+    return -1;
+  }
+
+  *out = v;
+  return 0;
+}
+
+// A snapshot of the vocabulary file, with the corrections of v
+vocab_snapshot *vocab_snapshot_load(vocab *v) {
+  vocab_snapshot *snapshot = NULL;
+  const phash_vocab *compiled = vocab_find_compiled(v->path);
+  if (compiled != NULL) {
+    snapshot = vocab_snapshot_from_compiled(compiled);
+  } else if (vocab_snapshot_from_file(v->path, &snapshot) == 1) {
+    snapshot = vocab_snapshot_from_txt(v->path);
+  }
+
+  if (snapshot != NULL) {
+    snapshot->source_to_target.corrections = &v->source_to_target_corrections;
+    snapshot->target_to_source.corrections = &v->target_to_source_corrections;
+  }
+  return snapshot;
+}
 
-char *reattach_username(char *original_message, char *translated_message) {
-  char *username_end = strchr(original_message, ':');
-  if (username_end) {
-    size_t username_len = username_end - original_message;
-    char *final_message = malloc(username_len + strlen(translated_message) + 3);
+const char *vocab_snapshot_kind(const vocab_snapshot *v) {
+  if (v->file.map != NULL) {
+    return "mapped perfect hash";
+  }
+  if (v->source_to_target.compiled != NULL) {
+    return "compiled perfect hash";
+  }
+  return ht_backend();
+}
 
-    if (final_message) {
-      snprintf(final_message, username_len + strlen(translated_message) + 3,
-               "%.*s: %s", (int)username_len, original_message,
-               translated_message);
-      return final_message;
+// What the vocabulary was loaded as, with the Bloom filters in front of its
+// hash tables: the false positive rate is the share of unknown words still
+// probing a table
+void vocab_print(const vocab *v, const char *event) {
+  const vocab_snapshot *snapshot = atomic_load(&v->current);
+  printf("Vocabulary %s%s: %s", v->path, event, vocab_snapshot_kind(snapshot));
+
+  const dictionary *directions[] = {&snapshot->source_to_target,
+                                    &snapshot->target_to_source};
+  const char *separator = ", Bloom filters";
+  for (int i = 0; i < 2; i++) {
+    const ht_hash_table *table = directions[i]->table;
+    if (table != NULL && table->filter != NULL) {
+      printf("%s %zu KiB, %.2f%% false positives", separator,
+             (bloom_size(table->filter) + 1023) / 1024,
+             100 * bloom_false_positive_rate(table->filter));
+      separator = " and";
     }
   }
-  return translated_message;
+  printf("\n");
 }
 
-char *translate_phrase(ht_hash_table *dictionary, char *phrase) {
-  char *result = malloc(BUFSIZE);
-  if (!result) {
+// Rooms using the same vocabulary file share its tables
+vocab *vocab_get(const char *path) {
+  for (int i = 0; i < vocab_count; i++) {
+    if (strcmp(vocabs[i]->path, path) == 0) {
+      return vocabs[i];
+    }
+  }
+
+  vocab *v = malloc(sizeof(vocab));
+  if (v == NULL) {
     return NULL;
   }
+  snprintf(v->path, sizeof(v->path), "%s", path);
+  v->source_to_target_corrections.words = cht_new();
+  v->target_to_source_corrections.words = cht_new();
+  atomic_init(&v->source_to_target_corrections.phrases, NULL);
+  atomic_init(&v->target_to_source_corrections.phrases, NULL);
+
+  vocab_snapshot *snapshot = NULL;
+  if (v->source_to_target_corrections.words != NULL &&
+      v->target_to_source_corrections.words != NULL) {
+    snapshot = vocab_snapshot_load(v);
+  }
+  if (snapshot == NULL) {
+    cht_del_hash_table(v->source_to_target_corrections.words);
+    cht_del_hash_table(v->target_to_source_corrections.words);
+    free(v);
+    return NULL;
+  }
+
+  atomic_init(&v->current, snapshot);
+  atomic_init(&v->generation, 0);
+  v->id = vocab_count;
+  vocabs[vocab_count++] = v;
+  return v;
+}
+
+// Load the file again and swap the new snapshot in. Translations running
+// meanwhile finish with the old one, freed once they are all done.
+int vocab_reload(vocab *v) {
+  vocab_snapshot *snapshot = vocab_snapshot_load(v);
+  if (snapshot == NULL) {
+    return -1;
+  }
 
-  result[0] = '\0';
-  char *word = strtok(phrase, " ");
-  size_t result_len = 0;
+  vocab_snapshot *old = atomic_exchange(&v->current, snapshot);
+  atomic_fetch_add(&v->generation, 1);
+  rcu_synchronize();
+  vocab_snapshot_free(old);
+  return 0;
+}
+
+void vocab_free(vocab *v) {
+  vocab_snapshot_free(atomic_load(&v->current));
+  cht_del_hash_table(v->source_to_target_corrections.words);
+  cht_del_hash_table(v->target_to_source_corrections.words);
+  phrase_dictionary_free(atomic_load(&v->source_to_target_corrections.phrases));
+  phrase_dictionary_free(atomic_load(&v->target_to_source_corrections.phrases));
+  free(v);
+}
 
-  while (word != NULL) {
-    first_letter_uppercase(word);
+// Key and value, either a word or a phrase. A phrase goes into a copy of the
+// trie swapped in for the old one: translations still reading the old one
+// finish before it's freed. Correction files are a few lines, copying the
+// trie for each is cheap.
+void corrections_add(dictionary_corrections *c, const char *key,
+                     const char *value) {
+  cht_insert(c->words, key, value);
+
+  token words[PHRASE_MAX_WORDS];
+  if (phrase_key_words(key, strlen(key), words) == 0) {
+    return;
+  }
+
+  phrase_dictionary *old = atomic_load(&c->phrases);
+  phrase_dictionary *phrases =
+      old != NULL ? phrase_dictionary_copy(old) : phrase_dictionary_new();
+  if (phrases == NULL || phrase_dictionary_add(phrases, key, value) < 0) {
+    perror("Failed to allocate corrected phrase");
+    phrase_dictionary_free(phrases);
+    return;
+  }
+
+  atomic_store(&c->phrases, phrases);
+  if (old != NULL) {
+    rcu_synchronize();
+    phrase_dictionary_free(old);
+  }
+}
+
+// Corrections, one per line: vocabulary file,source,target. They go into
+// both directions of the vocabulary in place, while the workers translate
+// with it: no snapshot is rebuilt. Returns how many were applied.
+int corrections_apply(const char *path) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    return -1;
+  }
 
-    char *translated_word = ht_search(dictionary, word);
-    if (translated_word == NULL) {
-      translated_word = word;
+  int applied = 0;
+  char line[MAX_LENGTH];
+  while (fgets(line, MAX_LENGTH, file) != NULL) {
+    line[strcspn(line, "\n")] = 0;
+    if (line[0] == '#') {
+      continue;
     }
 
-    int bytes_written = snprintf(result + result_len, BUFSIZE - result_len,
-                                 "%s ", translated_word);
+    char *saveptr;
+    char *vocab_path = strtok_r(line, ",", &saveptr);
+    char *source = strtok_r(NULL, ",", &saveptr);
+    char *target = strtok_r(NULL, ",", &saveptr);
+    if (target == NULL) {
+      continue;
+    }
 
-    if (bytes_written > 0) {
-      result_len += bytes_written;
-    } else {
-      break;
+    vocab *v = NULL;
+    for (int i = 0; i < vocab_count && v == NULL; i++) {
+      if (strcmp(vocabs[i]->path, vocab_path) == 0) {
+        v = vocabs[i];
+      }
+    }
+    if (v == NULL) {
+      fprintf(stderr, "Correction for %s, no room uses it\n", vocab_path);
+      continue;
     }
 
-    word = strtok(NULL, " ");
+    char key[MAX_LENGTH];
+    ht_fold_key(key, source);
+    corrections_add(&v->source_to_target_corrections, key, target);
+    ht_fold_key(key, target);
+    corrections_add(&v->target_to_source_corrections, key, source);
+    atomic_fetch_add(&v->generation, 1);
+    applied++;
   }
 
-  if (result_len < BUFSIZE) {
-    result[result_len - 1] = '\0';
+  fclose(file);
+  return applied;
+}
+
+// Only inside an RCU read section, the dictionary is gone after it
+const dictionary *room_dictionary(const room *room) {
+  const vocab_snapshot *v = atomic_load(&room->vocab->current);
+  return room->reverse ? &v->target_to_source : &v->source_to_target;
+}
+
+// Cached translations of the room's direction. The generation is read
+// before the dictionary: what's cached under it was translated with this
+// dictionary or a newer one.
+uint64_t room_cache_tag(const room *room) {
+  return (uint64_t)room->vocab->id << 33 |
+         (uint64_t)atomic_load(&room->vocab->generation) << 1 |
+         (uint64_t)room->reverse;
+}
+
+// Any case of a word finds it: keys are folded, the word is folded while
+// it's looked up, in place
+const char *dictionary_search(const dictionary *d, const char *word,
+                              const size_t len) {
+  const char *corrected = cht_search_fold(d->corrections->words, word, len);
+  if (corrected != NULL) {
+    return corrected;
+  }
+
+  if (d->compiled != NULL) {
+    return phash_search_fold(d->compiled, word, len);
+  }
+  return ht_search_fold(d->table, word, len);
+}
+
+// How a word is written, its translation is written the same way
+typedef enum {
+  WORD_CASE_LOWER,       // hello
+  WORD_CASE_CAPITALIZED, // Hello
+  WORD_CASE_UPPER,       // HELLO
+  WORD_CASE_MIXED,       // hELLo: the translation is left as in the file
+} word_case;
+
+word_case word_case_of(const char *word, const size_t len) {
+  size_t letters = 0, upper = 0;
+  for (size_t i = 0; i < len; i++) {
+    if (isalpha((unsigned char)word[i])) {
+      letters++;
+      upper += isupper((unsigned char)word[i]) != 0;
+    }
+  }
+
+  if (upper == 0) {
+    return WORD_CASE_LOWER;
+  }
+  if (upper == letters && letters > 1) {
+    return WORD_CASE_UPPER;
+  }
+  if (upper == 1 && isupper((unsigned char)word[0])) {
+    return WORD_CASE_CAPITALIZED;
+  }
+  return WORD_CASE_MIXED;
+}
+
+// Capitalized only changes the first letter, the file has the rest right
+void apply_word_case(char *s, const size_t len, const word_case style) {
+  if (style == WORD_CASE_CAPITALIZED && len > 0) {
+    s[0] = toupper((unsigned char)s[0]);
+    return;
+  }
+
+  for (size_t i = 0; i < len; i++) {
+    if (style == WORD_CASE_LOWER) {
+      s[i] = tolower((unsigned char)s[i]);
+    } else if (style == WORD_CASE_UPPER) {
+      s[i] = toupper((unsigned char)s[i]);
+    }
+  }
+}
+
+// Translate the len bytes of phrase into out, which gets at most out_size
+// of them and no NUL. Words are spans of the phrase found by the tokenizer,
+// in place: the phrase is only read, and nothing is allocated, so any number
+// of workers can translate at once. Spaces and punctuation between words
+// come out as they were, around the translations ("Hello, you!" gives "Ciao,
+// tu!"), and whatever doesn't fit anymore is left out. Returns the bytes
+// written.
+size_t translate_phrase(const dictionary *dictionary, const char *phrase,
+                        size_t len, char *out, const size_t out_size) {
+  if (len > PROTO_MAX_BODY) {
+    len = PROTO_MAX_BODY;
+  }
+
+  token tokens[TOKENIZER_MAX_TOKENS(PROTO_MAX_BODY)];
+  const size_t count = tokenizer_split(phrase, len, tokens);
+  const phrase_dictionary *corrected_phrases =
+      atomic_load(&dictionary->corrections->phrases);
+  size_t out_len = 0;
+  size_t copied = 0; // phrase bytes before it are in out
+
+  for (size_t i = 0; i <= count; i++) {
+    const size_t next = i < count ? tokens[i].start : len;
+    if (out_len + next - copied > out_size) {
+      break;
+    }
+    memcpy(out + out_len, phrase + copied, next - copied);
+    out_len += next - copied;
+    if (i == count) {
+      break;
+    }
+
+    // The longest phrase starting at this word, or the word alone. A phrase
+    // is written in the case of its words as a whole ("Va bene" gives
+    // "Alright"). A corrected phrase wins over the vocabulary's as long.
+    const char *word = phrase + tokens[i].start;
+    size_t word_len = tokens[i].len;
+    const char *translated = NULL;
+    size_t words = 0;
+    if (dictionary->phrases != NULL) {
+      words = phrase_dictionary_match(dictionary->phrases, phrase, &tokens[i],
+                                      count - i, &translated);
+    }
+    if (corrected_phrases != NULL) {
+      const char *corrected = NULL;
+      const size_t corrected_words = phrase_dictionary_match(
+          corrected_phrases, phrase, &tokens[i], count - i, &corrected);
+      if (corrected_words > 0 && corrected_words >= words) {
+        words = corrected_words;
+        translated = corrected;
+      }
+    }
+    if (words > 0) {
+      word_len = tokens[i + words - 1].start + tokens[i + words - 1].len -
+                 tokens[i].start;
+      i += words - 1;
+    } else {
+      translated = dictionary_search(dictionary, word, word_len);
+    }
+
+    size_t translated_len = word_len;
+    word_case style = WORD_CASE_MIXED;
+    if (translated == NULL) {
+      translated = word;
+    } else {
+      translated_len = strlen(translated);
+      style = word_case_of(word, word_len);
+    }
+
+    if (out_len + translated_len > out_size) {
+      break;
+    }
+    memcpy(out + out_len, translated, translated_len);
+    apply_word_case(out + out_len, translated_len, style);
+    out_len += translated_len;
+    copied = word + word_len - phrase;
   }
 
-  return result;
+  return out_len;
 }
 // +++++++++++++++++++++++++++++++++++++++++++++++++++++++
 
@@ -137,449 +675,1150 @@ char *translate_phrase(ht_hash_table *dictionary, char *phrase) {
 //
 // +++++++++++++++++++++++++++++++++++++++++++++++++++++++
 //
+// Every client is a connection owned by exactly one reactor (event loop
+// thread). Sockets are non-blocking, so a connection is a small state machine
+// instead of a blocked thread.
+typedef enum {
+  CONN_ACTIVE,  // inside the room, chatting
+  CONN_WAITING, // room was full, waiting in the queue for "NOT LOCKED"
+  CONN_CLOSING, // left the room, flushing the last bytes before close
+} connection_state;
+
+typedef struct translation_job translation_job;
+
+struct connection {
+  reactor_stream stream;
+  room *room;
+  connection_state state;
+  proto_parser parser;
+
+  // Frames waiting for a translation worker. A connection has at most one
+  // job with the workers, so its messages reach the room in order.
+  translation_job *jobs_head;
+  translation_job *jobs_tail;
+  int jobs_queued; // not counting the one in flight
+  int job_in_flight;
+  int leaving; // "/ciao" or KICKED was read, what follows is ignored
+
+  // Room member list or waiting queue, protected by the room mutex
+  connection *prev;
+  connection *next;
+};
+
+// Frames read from one client, translated by a worker into frames for the
+// room, then fanned out by a second job on the same scheduler: one lock and
+// one queued buffer per member for the whole job instead of per message.
+// The job is handed back to the client's reactor only after the fan-out.
+struct translation_job {
+  worker_job job;
+  reactor_task done;
+  translation_job *next;
+  connection *c;
+
+  char in[TRANSLATION_JOB_SIZE];
+  size_t in_len;
+
+  char *out;
+  size_t out_len;
+  size_t out_capacity;
+  int out_messages;
+  int leaving;
+};
+
+// One accept shard of a room port, every reactor has its own
 typedef struct {
-  int client_socket;
-  vocab *vocabulary;
-} clientinfo;
+  reactor_listener listener;
+  room *room;
+  int shard;
+  atomic_ulong accepted;
+} room_listener;
+
+reactor_engine io_engine = REACTOR_EPOLL;
+int reactor_count = 0;
+int listen_backlog = SOMAXCONN;
+int stats_interval = 0;
+int worker_count = -1;
+int worker_queue_size = 1024;
+const char *corrections_file = CORRECTIONS_FILE;
+size_t translation_cache_size = TRANSLATION_CACHE_SIZE;
+cache translation_cache;
+worker_pool translation_pool;
+reactor_backpressure backpressure = {REACTOR_HIGH_WATERMARK,
+                                     REACTOR_LOW_WATERMARK,
+                                     REACTOR_DROP_OLDEST};
+reactor *reactors;
+room_listener *listeners;
+
+// Called with the room mutex held
+void room_add_member(room *room, connection *c) {
+  c->prev = NULL;
+  c->next = room->members;
+  if (room->members != NULL) {
+    room->members->prev = c;
+  }
+  room->members = c;
+  room->member_count++;
+}
 
-void broadcast_message_english_to_italian(const char *message,
-                                          int sender_socket) {
-  pthread_mutex_lock(&waiting_clients_english_to_italian_mutex);
-  if (!is_client_q_empty(waiting_client_queue_english_to_italian)) {
-    int next_client =
-        waiting_client_queue_english_to_italian
-            ->clients[waiting_client_queue_english_to_italian->front];
-    send(next_client, message, strlen(message), 0);
+// Called with the room mutex held
+void room_remove_member(room *room, connection *c) {
+  if (c->prev != NULL) {
+    c->prev->next = c->next;
+  } else {
+    room->members = c->next;
+  }
+  if (c->next != NULL) {
+    c->next->prev = c->prev;
   }
-  pthread_mutex_unlock(&waiting_clients_english_to_italian_mutex);
+  c->prev = NULL;
+  c->next = NULL;
+  room->member_count--;
 }
 
-void broadcast_message_italian_to_english(const char *message,
-                                          int sender_socket) {
-  pthread_mutex_lock(&waiting_clients_italian_to_english_mutex);
-  if (!is_client_q_empty(waiting_client_queue_italian_to_english)) {
-    int next_client =
-        waiting_client_queue_italian_to_english
-            ->clients[waiting_client_queue_italian_to_english->front];
-    send(next_client, message, strlen(message), 0);
+// Called with the room mutex held
+void room_enqueue_waiting(room *room, connection *c) {
+  c->next = NULL;
+  c->prev = room->waiting_tail;
+  if (room->waiting_tail != NULL) {
+    room->waiting_tail->next = c;
+  } else {
+    room->waiting_head = c;
   }
-  pthread_mutex_unlock(&waiting_clients_italian_to_english_mutex);
+  room->waiting_tail = c;
+  room->waiting_count++;
 }
 
-void *handle_client_english_to_italian(void *arg) {
-  char client_english_to_italian_buffer[BUFSIZE];
-  clientinfo *client_info = (clientinfo *)arg;
+// Called with the room mutex held
+void room_remove_waiting(room *room, connection *c) {
+  if (c->prev != NULL) {
+    c->prev->next = c->next;
+  } else {
+    room->waiting_head = c->next;
+  }
+  if (c->next != NULL) {
+    c->next->prev = c->prev;
+  } else {
+    room->waiting_tail = c->prev;
+  }
+  c->prev = NULL;
+  c->next = NULL;
+  room->waiting_count--;
+}
 
-  if (atomic_load(&waiting_english_to_italian_clients) >= MAX_USERS_PER_ROOM) {
-    pthread_mutex_lock(&waiting_clients_english_to_italian_mutex);
-    client_enqueue(waiting_client_queue_english_to_italian,
-                   client_info->client_socket);
-    pthread_mutex_unlock(&waiting_clients_english_to_italian_mutex);
+// One encoded frame, ready to be queued on any number of streams
+reactor_buffer *frame_buffer_new(proto_type type, const char *username,
+                                 size_t username_len, const char *body,
+                                 size_t body_len) {
+  reactor_buffer *b =
+      reactor_buffer_new(NULL, proto_frame_size(username_len, body_len));
+  if (b == NULL) {
+    perror("Failed to allocate message");
+    return NULL;
+  }
 
-    printf("\033[33m"
-           "A user tried to enter the room, but it's full...\n"
-           "\033[0m");
+  if (proto_encode(b->data, b->len, type, 0, username, username_len, body,
+                   body_len) == 0) {
+    reactor_buffer_unref(b);
+    return NULL;
+  }
+  return b;
+}
 
-    memset(client_english_to_italian_buffer, 0, BUFSIZE);
-    snprintf(client_english_to_italian_buffer, BUFSIZE, "LOCKED");
+// Called with the room mutex held. Goes through the output queue of the first
+// waiting client like any other message, so a client that doesn't read can't
+// block the room.
+void broadcast_message(room *room, proto_type type) {
+  if (room->waiting_head == NULL) {
+    return;
+  }
 
-    // Send the response to the client
-    send(client_info->client_socket, client_english_to_italian_buffer,
-         strlen(client_english_to_italian_buffer), 0);
+  reactor_buffer *b = frame_buffer_new(type, NULL, 0, NULL, 0);
+  if (b == NULL) {
+    return;
+  }
+  reactor_stream_send(&room->waiting_head->stream, b);
+  reactor_buffer_unref(b);
+}
 
-    return NULL;
+unsigned long long elapsed_ns(const struct timespec *start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) * 1000000000ULL + now.tv_nsec -
+         start->tv_nsec;
+}
+
+// Hand the same message to every member of the room, the sender included.
+// The buffer is formatted once and only referenced by each member's output
+// queue; members not served by the calling thread get it through their
+// reactor's mailbox. Holding the room mutex keeps every member alive
+// meanwhile.
+void room_fanout(room *room, reactor_buffer *b, int messages) {
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  pthread_mutex_lock(&room->mutex);
+  for (connection *m = room->members; m != NULL; m = m->next) {
+    reactor_stream_send(&m->stream, b);
   }
 
-  int client_to_remove = -1;
-  pthread_mutex_lock(&waiting_clients_english_to_italian_mutex);
-  if (!is_client_q_empty(waiting_client_queue_english_to_italian)) {
-    client_to_remove = client_dequeue(waiting_client_queue_english_to_italian);
+  unsigned long long ns = elapsed_ns(&start);
+  room->fanout_messages += messages;
+  room->fanout_count++;
+  room->fanout_ns_total += ns;
+  if (ns > room->fanout_ns_max) {
+    room->fanout_ns_max = ns;
   }
-  pthread_mutex_unlock(&waiting_clients_english_to_italian_mutex);
+  pthread_mutex_unlock(&room->mutex);
+}
 
-  atomic_fetch_add(&waiting_english_to_italian_clients, 1);
+void connection_send(reactor *r, connection *c, proto_type type) {
+  reactor_buffer *b = frame_buffer_new(type, NULL, 0, NULL, 0);
+  if (b == NULL) {
+    return;
+  }
 
-  while (1) {
-    memset(client_english_to_italian_buffer, 0, BUFSIZE);
+  // A refused buffer is counted by the reactor, -s reports it with the other
+  // drops: nothing is printed on the path of an overloaded client
+  reactor_stream_write_buffer(r, &c->stream, b);
+  reactor_buffer_unref(b);
+}
 
-    // Receive message from client
-    int bytes_received_message =
-        recv(client_info->client_socket, client_english_to_italian_buffer,
-             BUFSIZE, 0);
+// Give back the room seat (or the queue place), after this the connection is
+// only waiting to be closed
+void connection_leave_room(connection *c) {
+  pthread_mutex_lock(&c->room->mutex);
+  if (c->state == CONN_ACTIVE) {
+    room_remove_member(c->room, c);
+    broadcast_message(c->room, PROTO_NOT_LOCKED);
+  } else if (c->state == CONN_WAITING) {
+    room_remove_waiting(c->room, c);
+  }
+  pthread_mutex_unlock(&c->room->mutex);
 
-    client_english_to_italian_buffer[bytes_received_message] = '\0';
-    // printf("Received from client: %s\n", client_english_to_italian_buffer);
+  c->state = CONN_CLOSING;
+}
 
-    if (strcmp(client_english_to_italian_buffer, "KICKED") == 0) {
-      memset(client_english_to_italian_buffer, 0, BUFSIZE);
-      snprintf(client_english_to_italian_buffer, BUFSIZE, "NOT LOCKED");
+// Leave the room now, the socket is closed after the last reply is sent
+void connection_shutdown(reactor *r, connection *c) {
+  connection_leave_room(c);
+  reactor_stream_close(r, &c->stream);
+}
 
-      broadcast_message_english_to_italian(client_english_to_italian_buffer,
-                                           client_info->client_socket);
+// Translation jobs
+//
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+void translation_job_run(worker_job *w);
+void translation_job_fanout(worker_job *w);
+void translation_job_done(reactor *r, reactor_task *t);
+
+translation_job *translation_job_new(connection *c) {
+  translation_job *job = malloc(sizeof(translation_job));
+  if (job == NULL) {
+    perror("Failed to allocate translation job");
+    return NULL;
+  }
 
-      break;
-    }
+  job->job.run = translation_job_run;
+  job->done.run = translation_job_done;
+  job->next = NULL;
+  job->c = c;
+  job->in_len = 0;
+  job->out = NULL;
+  job->out_len = 0;
+  job->out_capacity = 0;
+  job->out_messages = 0;
+  job->leaving = 0;
+  return job;
+}
 
-    // Remove the user: and read only the message
-    char *message_without_user = strchr(client_english_to_italian_buffer, ':');
-    if (message_without_user != NULL) {
-      message_without_user += 2;
+void translation_job_free(translation_job *job) {
+  free(job->out);
+  free(job);
+}
+
+// Room at the end of the output for size more bytes
+int translation_job_reserve(translation_job *job, size_t size) {
+  if (job->out_len + size <= job->out_capacity) {
+    return 0;
+  }
+
+  size_t capacity = job->out_capacity > 0 ? job->out_capacity * 2 : 4096;
+  while (capacity < job->out_len + size) {
+    capacity *= 2;
+  }
+
+  char *out = realloc(job->out, capacity);
+  if (out == NULL) {
+    return -1;
+  }
+  job->out = out;
+  job->out_capacity = capacity;
+  return 0;
+}
+
+// The translation of a short message is looked up in the cache first, and
+// kept there once translated: the message as it came is the key, its case
+// and punctuation are part of the translation. Commands ("/ciao") go out as
+// they came, whatever the language of the room.
+size_t translate_message(const dictionary *dictionary, const uint64_t tag,
+                         const char *message, const size_t len, char *out) {
+  if (len > 0 && message[0] == '/') {
+    const size_t out_len = len < PROTO_MAX_BODY ? len : PROTO_MAX_BODY;
+    memcpy(out, message, out_len);
+    return out_len;
+  }
+
+  const int cached =
+      translation_cache_size > 0 && len <= TRANSLATION_CACHE_MAX_MESSAGE;
+  if (cached) {
+    long hit =
+        cache_get(&translation_cache, tag, message, len, out, PROTO_MAX_BODY);
+    if (hit >= 0) {
+      return (size_t)hit;
     }
+  }
 
-    // Translate the phrase
-    char *translated_phrase = translate_phrase(
-        client_info->vocabulary->english_to_italian, message_without_user);
+  size_t out_len = translate_phrase(dictionary, message, len, out,
+                                    PROTO_MAX_BODY);
+  if (cached) {
+    cache_put(&translation_cache, tag, message, len, out, out_len);
+  }
+  return out_len;
+}
+
+// Translate a frame straight into the output: the body goes where the frame
+// keeps it, then the header and username are written in front of it
+int translation_job_append(translation_job *job,
+                           const dictionary *dictionary, const uint64_t tag,
+                           const proto_frame *frame) {
+  if (translation_job_reserve(
+          job, proto_frame_size(frame->username_len, PROTO_MAX_BODY)) < 0) {
+    return -1;
+  }
+
+  char *out = job->out + job->out_len;
+  char *body = out + proto_frame_size(frame->username_len, 0);
+  size_t body_len =
+      translate_message(dictionary, tag, frame->body, frame->body_len, body);
+  printf("%.*s: %.*s\n", (int)frame->username_len, frame->username,
+         (int)body_len, body);
+
+  job->out_len += proto_encode_header(out, job->out_capacity - job->out_len,
+                                      PROTO_CHAT, 0, frame->username,
+                                      frame->username_len, body_len);
+  job->out_messages++;
+  return 0;
+}
 
-    // Reattach the username
-    char *final_message =
-        reattach_username(client_english_to_italian_buffer, translated_phrase);
+// Runs on a worker: translate every frame, the username goes out as it came
+void translation_job_run(worker_job *w) {
+  translation_job *job = (translation_job *)w;
+  const char *in = job->in;
+  size_t left = job->in_len;
+  proto_frame frame;
+  long size;
 
-    printf("%s\n", final_message);
+  rcu_read_lock();
+  const uint64_t tag = room_cache_tag(job->c->room);
+  const dictionary *dictionary = room_dictionary(job->c->room);
 
-    memset(client_english_to_italian_buffer, 0, BUFSIZE);
-    snprintf(client_english_to_italian_buffer, BUFSIZE, "%s", final_message);
+  while (left > 0 && (size = proto_decode(in, left, &frame)) > 0) {
+    in += size;
+    left -= size;
 
-    // Send the response to the client
-    send(client_info->client_socket, client_english_to_italian_buffer,
-         strlen(client_english_to_italian_buffer), 0);
-    free(translated_phrase);
-    free(final_message);
+    if (frame.type == PROTO_KICKED) {
+      job->leaving = 1;
+      break;
+    }
 
-    if (strcmp(message_without_user, "/ciao") == 0 ||
-        strcmp(message_without_user, "/exit") == 0) {
-      memset(client_english_to_italian_buffer, 0, BUFSIZE);
-      snprintf(client_english_to_italian_buffer, BUFSIZE, "NOT LOCKED");
+    int leaving = frame.body_len == 5 && (memcmp(frame.body, "/ciao", 5) == 0 ||
+                                          memcmp(frame.body, "/exit", 5) == 0);
 
-      broadcast_message_english_to_italian(client_english_to_italian_buffer,
-                                           client_info->client_socket);
+    if (translation_job_append(job, dictionary, tag, &frame) < 0) {
+      perror("Failed to allocate translation");
+    }
 
+    if (leaving) {
+      job->leaving = 1;
       break;
     }
   }
+  rcu_read_unlock();
 
-  close(client_info->client_socket);
-  free(client_info);
-
-  atomic_fetch_sub(&waiting_english_to_italian_clients, 1);
+  if (job->out_messages == 0) {
+    reactor_post_task(job->c->stream.owner, &job->done);
+    return;
+  }
 
-  return NULL;
+  // Submitted from a worker it lands on that worker's deque: it runs next
+  // while the output is still in cache, unless an idle worker steals it first
+  job->job.run = translation_job_fanout;
+  worker_pool_submit(&translation_pool, &job->job);
 }
 
-void *handle_client_italian_to_english(void *arg) {
-  char client_italian_to_english_buffer[BUFSIZE];
-  clientinfo *client_info = (clientinfo *)arg;
+// Runs on a worker, the room mutex keeps every member alive meanwhile
+void translation_job_fanout(worker_job *w) {
+  translation_job *job = (translation_job *)w;
 
-  if (atomic_load(&waiting_italian_to_english_clients) >= MAX_USERS_PER_ROOM) {
-    pthread_mutex_lock(&waiting_clients_italian_to_english_mutex);
-    client_enqueue(waiting_client_queue_italian_to_english,
-                   client_info->client_socket);
-    pthread_mutex_unlock(&waiting_clients_italian_to_english_mutex);
+  reactor_buffer *b = reactor_buffer_new(job->out, job->out_len);
+  if (b != NULL) {
+    room_fanout(job->c->room, b, job->out_messages);
+    reactor_buffer_unref(b);
+  } else {
+    perror("Failed to allocate message");
+  }
 
-    printf("\033[33m"
-           "A user tried to enter the room, but it's full...\n"
-           "\033[0m");
+  reactor_post_task(job->c->stream.owner, &job->done);
+}
 
-    memset(client_italian_to_english_buffer, 0, BUFSIZE);
-    snprintf(client_italian_to_english_buffer, BUFSIZE, "LOCKED");
+// Reading stops while the pool is saturated, the job coming back resumes it.
+// 1 when the job was parked.
+int connection_submit_next_job(reactor *r, connection *c) {
+  if (c->job_in_flight || c->jobs_head == NULL) {
+    return 0;
+  }
 
-    // Send the response to the client
-    send(client_info->client_socket, client_italian_to_english_buffer,
-         strlen(client_italian_to_english_buffer), 0);
+  translation_job *job = c->jobs_head;
+  c->jobs_head = job->next;
+  if (c->jobs_head == NULL) {
+    c->jobs_tail = NULL;
+  }
+  c->jobs_queued--;
+
+  // The job keeps the connection alive until it's back
+  c->job_in_flight = 1;
+  reactor_stream_ref(&c->stream);
+  if (worker_pool_submit(&translation_pool, &job->job) > 0) {
+    reactor_stream_hold_reading(r, &c->stream);
+    return 1;
+  }
+  return 0;
+}
 
-    return NULL;
+// Back on the connection's reactor
+void translation_job_done(reactor *r, reactor_task *t) {
+  translation_job *job =
+      (translation_job *)((char *)t - offsetof(translation_job, done));
+  connection *c = job->c;
+
+  c->job_in_flight = 0;
+  if (job->leaving && c->state == CONN_ACTIVE) {
+    connection_shutdown(r, c);
   }
+  translation_job_free(job);
 
-  int client_to_remove = -1;
-  pthread_mutex_lock(&waiting_clients_italian_to_english_mutex);
-  if (!is_client_q_empty(waiting_client_queue_italian_to_english)) {
-    client_to_remove = client_dequeue(waiting_client_queue_italian_to_english);
+  if (c->state == CONN_ACTIVE) {
+    if (connection_submit_next_job(r, c) == 0 &&
+        c->jobs_queued <= CONNECTION_RESUME_JOBS) {
+      reactor_stream_release_reading(r, &c->stream);
+    }
   }
-  pthread_mutex_unlock(&waiting_clients_italian_to_english_mutex);
+  reactor_stream_unref(&c->stream);
+}
 
-  atomic_fetch_add(&waiting_italian_to_english_clients, 1);
+// Copy a frame into the last waiting job of the connection
+void connection_queue_frame(connection *c, const proto_frame *frame) {
+  if (frame->type == PROTO_KICKED) {
+    c->leaving = 1;
+  } else if (frame->type == PROTO_CHAT && frame->body_len > 0) {
+    if ((frame->body_len == 5 && memcmp(frame->body, "/ciao", 5) == 0) ||
+        (frame->body_len == 5 && memcmp(frame->body, "/exit", 5) == 0)) {
+      c->leaving = 1;
+    }
+  } else {
+    return;
+  }
 
-  while (1) {
-    memset(client_italian_to_english_buffer, 0, BUFSIZE);
+  size_t size = proto_frame_size(frame->username_len, frame->body_len);
+  translation_job *job = c->jobs_tail;
 
-    // Receive data from client
-    int bytes_received_message =
-        recv(client_info->client_socket, client_italian_to_english_buffer,
-             BUFSIZE, 0);
+  if (job == NULL || job->in_len + size > sizeof(job->in)) {
+    job = translation_job_new(c);
+    if (job == NULL) {
+      return;
+    }
 
-    client_italian_to_english_buffer[bytes_received_message] = '\0';
-    // printf("Received from client: %s\n", client_italian_to_english_buffer);
+    if (c->jobs_tail != NULL) {
+      c->jobs_tail->next = job;
+    } else {
+      c->jobs_head = job;
+    }
+    c->jobs_tail = job;
+    c->jobs_queued++;
+  }
 
-    if (strcmp(client_italian_to_english_buffer, "KICKED") == 0) {
-      memset(client_italian_to_english_buffer, 0, BUFSIZE);
-      snprintf(client_italian_to_english_buffer, BUFSIZE, "NOT LOCKED");
+  job->in_len += proto_encode(job->in + job->in_len,
+                              sizeof(job->in) - job->in_len, frame->type, 0,
+                              frame->username, frame->username_len,
+                              frame->body, frame->body_len);
+}
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
 
-      broadcast_message_italian_to_english(client_italian_to_english_buffer,
-                                           client_info->client_socket);
+void connection_on_data(reactor *r, reactor_stream *s, char *data,
+                        size_t len) {
+  connection *c = (connection *)s;
 
+  // A recv can hold any number of pipelined frames, and the last one may be
+  // cut
+  while (len > 0) {
+    // Waiting clients only wait for "NOT LOCKED", closing ones are done
+    if (c->state != CONN_ACTIVE || c->leaving) {
       break;
     }
 
-    // Remove the user: and read only the message
-    char *message_without_user = strchr(client_italian_to_english_buffer, ':');
-    if (message_without_user != NULL) {
-      message_without_user += 2;
-    }
+    size_t taken = proto_parser_feed(&c->parser, data, len);
+    data += taken;
+    len -= taken;
 
-    // Translate the phrase
-    char *translated_phrase = translate_phrase(
-        client_info->vocabulary->italian_to_english, message_without_user);
+    proto_frame frame;
+    int res = 0;
+    while (!c->leaving && (res = proto_parser_next(&c->parser, &frame)) > 0) {
+      connection_queue_frame(c, &frame);
+    }
 
-    // Reattach the username
-    char *final_message =
-        reattach_username(client_italian_to_english_buffer, translated_phrase);
+    if (res < 0) {
+      printf("Client sent a malformed frame, disconnecting.\n");
+      connection_shutdown(r, c);
+      return;
+    }
+  }
 
-    // Print the message on screen (server)
-    printf("%s\n", final_message);
+  connection_submit_next_job(r, c);
+  if (c->jobs_queued >= CONNECTION_MAX_JOBS) {
+    reactor_stream_hold_reading(r, s);
+  }
+}
 
-    memset(client_italian_to_english_buffer, 0, BUFSIZE);
-    snprintf(client_italian_to_english_buffer, BUFSIZE, "%s", final_message);
+void connection_on_close(reactor *r, reactor_stream *s) {
+  (void)r;
+  connection *c = (connection *)s;
+  connection_leave_room(c);
 
-    // Send the response to the client
-    send(client_info->client_socket, client_italian_to_english_buffer,
-         strlen(client_italian_to_english_buffer), 0);
-    free(translated_phrase);
-    free(final_message);
+  while (c->jobs_head != NULL) {
+    translation_job *job = c->jobs_head;
+    c->jobs_head = job->next;
+    translation_job_free(job);
+  }
+  c->jobs_tail = NULL;
+  c->jobs_queued = 0;
+}
 
-    if (strcmp(message_without_user, "/ciao") == 0 ||
-        strcmp(message_without_user, "/exit") == 0) {
-      memset(client_italian_to_english_buffer, 0, BUFSIZE);
-      snprintf(client_italian_to_english_buffer, BUFSIZE, "NOT LOCKED");
+// Other reactors may still have had messages in flight for it until now
+void connection_on_release(reactor *r, reactor_stream *s) {
+  (void)r;
+  free((connection *)s);
+}
 
-      broadcast_message_italian_to_english(client_italian_to_english_buffer,
-                                           client_info->client_socket);
+void connection_open(reactor *r, room *room, int client_socket) {
+  connection *c = malloc(sizeof(connection));
+  if (c == NULL) {
+    close(client_socket);
+    return;
+  }
 
-      break;
-    }
+  c->stream.handler.fd = client_socket;
+  c->stream.on_data = connection_on_data;
+  c->stream.on_close = connection_on_close;
+  c->stream.on_release = connection_on_release;
+  c->room = room;
+  c->state = CONN_CLOSING;
+  proto_parser_init(&c->parser);
+  c->jobs_head = NULL;
+  c->jobs_tail = NULL;
+  c->jobs_queued = 0;
+  c->job_in_flight = 0;
+  c->leaving = 0;
+  c->prev = NULL;
+  c->next = NULL;
+
+  if (reactor_add_stream(r, &c->stream) < 0) {
+    perror("Failed to register client");
+    close(client_socket);
+    free(c);
+    return;
   }
 
-  close(client_info->client_socket);
-  free(client_info);
+  // Seat check and queueing happen under the room lock, so two reactors can't
+  // both take the last seat
+  pthread_mutex_lock(&room->mutex);
+  if (room->member_count >= room->capacity) {
+    c->state = CONN_WAITING;
+
+    printf("\033[33m"
+           "A user tried to enter the room, but it's full...\n"
+           "\033[0m");
 
-  atomic_fetch_sub(&waiting_italian_to_english_clients, 1);
+    connection_send(r, c, PROTO_LOCKED);
+    room_enqueue_waiting(room, c);
+  } else {
+    c->state = CONN_ACTIVE;
+
+    // The seat goes to the client that was told "NOT LOCKED", it comes back
+    // on a new connection and its old one stops waiting
+    if (room->waiting_head != NULL) {
+      connection *notified = room->waiting_head;
+      room_remove_waiting(room, notified);
+      notified->state = CONN_CLOSING;
+    }
 
-  return NULL;
+    room_add_member(room, c);
+  }
+  pthread_mutex_unlock(&room->mutex);
 }
 // +++++++++++++++++++++++++++++++++++++++++++++++++++++++
 
-void print_welcome_message(int client_socket, int room_type) {
+void print_welcome_message(int client_socket, room *room) {
   struct sockaddr_in client_addr;
   socklen_t addr_len = sizeof(client_addr);
   getpeername(client_socket, (struct sockaddr *)&client_addr, &addr_len);
   char timestamp[20];
+  struct tm now_tm;
   time_t now = time(NULL);
-  strftime(timestamp, 20, "%Y-%m-%d %H:%M:%S", localtime(&now));
+  strftime(timestamp, 20, "%Y-%m-%d %H:%M:%S", localtime_r(&now, &now_tm));
+  char ip[INET_ADDRSTRLEN];
+  inet_ntop(AF_INET, &client_addr.sin_addr, ip, sizeof(ip));
 
-  printf("[%s] New client connected %s: %s:%d\n", timestamp,
-         room_type == 1 ? "(English to Italian)" : "(Italian to English)",
-         inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
+  printf("[%s] New client connected (%s): %s:%d\n", timestamp, room->name,
+         ip, ntohs(client_addr.sin_port));
 }
 
 // Rooms
 //
 // +++++++++++++++++++++++++++++++++++++++++++++++++++++++
 //
-// English -> Italian
-void *room_english_to_italian(void *arg) {
-  vocab *v = (vocab *)arg;
+// Every reactor listens on its own socket for each room port, all bound with
+// SO_REUSEPORT: the kernel spreads incoming connections across the shards, so
+// a reconnect storm is accepted by every core instead of queueing behind one
+int create_listening_socket(int port) {
+  int server_fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (server_fd < 0) {
+    perror("socket failed");
+    return -1;
+  }
 
-  int client_socket;
-  struct sockaddr_in client_addr;
-  socklen_t addr_len = sizeof(client_addr);
-  char room_english_to_italian_buffer[BUFSIZE];
+  // Things for server shutdown
+  int opt = 1;
+  if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0 ||
+      setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+    perror("setsockopt failed");
+    close(server_fd);
+    return -1;
+  }
 
-  char *translated_str = NULL;
+  struct sockaddr_in server_addr;
+  memset(&server_addr, 0, sizeof(server_addr));
+  server_addr.sin_family = AF_INET;
+  server_addr.sin_addr.s_addr = INADDR_ANY;
+  server_addr.sin_port = htons(port);
 
-  while (1) {
-    // Accept a new connection
-    if ((client_socket = accept(server_fd_english_to_italian,
-                                (struct sockaddr *)&client_addr, &addr_len)) <
-        0) {
-      if (errno == EINTR || errno == ECONNABORTED) {
-        continue;
-      } else {
-        perror("accept failed");
-        close(server_fd_english_to_italian);
-        exit(EXIT_FAILURE);
-      }
+  if (bind(server_fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) <
+      0) {
+    perror("bind failed");
+    close(server_fd);
+    return -1;
+  }
+
+  if (set_nonblocking(server_fd) < 0) {
+    perror("fcntl failed");
+    close(server_fd);
+    return -1;
+  }
+
+  if (listen(server_fd, listen_backlog) < 0) {
+    perror("listen failed");
+    close(server_fd);
+    return -1;
+  }
+
+  return server_fd;
+}
+
+void room_on_accept(reactor *r, reactor_listener *l, int client_socket) {
+  room_listener *shard = (room_listener *)l;
+
+  atomic_fetch_add_explicit(&shard->accepted, 1, memory_order_relaxed);
+
+  print_welcome_message(client_socket, shard->room);
+
+  connection_open(r, shard->room, client_socket);
+}
+
+void room_listener_init(room_listener *l, room *room, int shard) {
+  l->listener.handler.fd = create_listening_socket(room->port);
+  if (l->listener.handler.fd < 0) {
+    fprintf(stderr, "Failed to listen on port %d\n", room->port);
+    exit(EXIT_FAILURE);
+  }
+
+  l->listener.on_accept = room_on_accept;
+  l->room = room;
+  l->shard = shard;
+  atomic_init(&l->accepted, 0);
+}
+
+// Load the rooms, one per line: name,port,vocabulary file,direction,capacity
+// where direction is "forward" to translate the first column of the
+// vocabulary into the second one, "reverse" for the opposite
+int rooms_setup_from_txt(const char *path) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    perror("Error opening rooms file");
+    return -1;
+  }
+
+  char line[MAX_LENGTH];
+  while (fgets(line, MAX_LENGTH, file) != NULL) {
+    line[strcspn(line, "\n")] = 0;
+    if (line[0] == '#' || line[0] == '\0') {
       continue;
     }
 
-    print_welcome_message(client_socket, 1);
+    if (room_count == MAX_ROOMS) {
+      fprintf(stderr, "Too many rooms, only the first %d are used\n",
+              MAX_ROOMS);
+      break;
+    }
 
-    clientinfo *client_info = malloc(sizeof(clientinfo));
-    client_info->client_socket = client_socket;
-    client_info->vocabulary = v;
+    room *room = &rooms[room_count];
+    char vocab_path[MAX_PATH_LENGTH];
+    char direction[16];
 
-    pthread_t client_thread;
-    if (pthread_create(&client_thread, NULL, handle_client_english_to_italian,
-                       (void *)client_info) != 0) {
-      perror("Failed to create client thread");
-      close(client_socket);
+    if (sscanf(line, "%63[^,],%d,%255[^,],%15[^,],%d", room->name, &room->port,
+               vocab_path, direction, &room->capacity) != 5 ||
+        room->capacity < 1) {
+      fprintf(stderr, "Invalid room: %s\n", line);
       continue;
     }
 
-    pthread_detach(client_thread);
+    vocab *v = vocab_get(vocab_path);
+    if (v == NULL) {
+      fprintf(stderr, "Room %s has no vocabulary\n", room->name);
+      continue;
+    }
+
+    room->vocab = v;
+    room->reverse = strcmp(direction, "reverse") == 0;
+    pthread_mutex_init(&room->mutex, NULL);
+    room->member_count = 0;
+    room->members = NULL;
+    room->waiting_count = 0;
+    room->waiting_head = NULL;
+    room->waiting_tail = NULL;
+    room->fanout_messages = 0;
+    room->fanout_count = 0;
+    room->fanout_ns_total = 0;
+    room->fanout_ns_max = 0;
+
+    room_count++;
   }
-  return NULL;
+
+  fclose(file);
+
+  return room_count > 0 ? 0 : -1;
 }
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+// Stats
+//
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+void print_server_stats() {
+  printf("\033[0;36m");
+  printf("--- Server stats ---\n");
+
+  for (int i = 0; i < room_count; i++) {
+    room *room = &rooms[i];
+
+    pthread_mutex_lock(&room->mutex);
+    int members = room->member_count;
+    int waiting = room->waiting_count;
+    unsigned long fanout_messages = room->fanout_messages;
+    unsigned long fanouts = room->fanout_count;
+    unsigned long long fanout_ns_total = room->fanout_ns_total;
+    unsigned long long fanout_ns_max = room->fanout_ns_max;
+    pthread_mutex_unlock(&room->mutex);
+
+    printf("%s: %d/%d in room, %d waiting, accepts per shard:", room->name,
+           members, room->capacity, waiting);
+
+    for (int shard = 0; shard < reactor_count; shard++) {
+      room_listener *l = &listeners[shard * room_count + i];
+      printf(" %lu", atomic_load_explicit(&l->accepted, memory_order_relaxed));
+    }
+    printf("\n");
 
-// Italian -> English
-void *room_italian_to_english(void *arg) {
-  vocab *v = (vocab *)arg;
+    if (fanouts > 0) {
+      printf("  %lu messages fanned out in %lu batches, avg %.1f us, max %.1f "
+             "us per batch\n",
+             fanout_messages, fanouts, fanout_ns_total / 1000.0 / fanouts,
+             fanout_ns_max / 1000.0);
+    }
+  }
 
-  int client_socket;
-  struct sockaddr_in client_addr;
-  socklen_t addr_len = sizeof(client_addr);
-  char room_italian_to_english_buffer[BUFSIZE];
+  printf("translation workers: %d, %lu jobs queued or running (max %lu), "
+         "%lu jobs, %lu spawned by a job, %lu stolen, %lu parked on a full "
+         "queue\n",
+         translation_pool.worker_count, worker_pool_depth(&translation_pool),
+         atomic_load_explicit(&translation_pool.max_depth,
+                              memory_order_relaxed),
+         atomic_load_explicit(&translation_pool.submitted,
+                              memory_order_relaxed),
+         atomic_load_explicit(&translation_pool.local_runs,
+                              memory_order_relaxed),
+         atomic_load_explicit(&translation_pool.steals, memory_order_relaxed),
+         atomic_load_explicit(&translation_pool.overflows,
+                              memory_order_relaxed));
+
+  if (translation_cache_size > 0) {
+    cache_stats cs;
+    cache_stats_get(&translation_cache, &cs);
+    unsigned long lookups = cs.hits + cs.misses;
+    printf("translation cache: %zu messages, %zu/%zu KiB, %lu hits, %lu "
+           "misses (%.1f%% hit ratio), %lu seen once, %lu evicted\n",
+           cs.entries, cs.bytes / 1024, cs.capacity / 1024, cs.hits,
+           cs.misses, lookups > 0 ? 100.0 * cs.hits / lookups : 0.0,
+           cs.rejections, cs.evictions);
+  }
+
+  for (int i = 0; i < reactor_count; i++) {
+    reactor_metrics *m = &reactors[i].metrics;
+    printf("reactor %d: %lu bytes queued, %lu read pauses, %lu congestions, "
+           "%lu dropped, %lu slow clients disconnected\n",
+           i, atomic_load_explicit(&m->queued_bytes, memory_order_relaxed),
+           atomic_load_explicit(&m->read_pauses, memory_order_relaxed),
+           atomic_load_explicit(&m->congestions, memory_order_relaxed),
+           atomic_load_explicit(&m->dropped, memory_order_relaxed),
+           atomic_load_explicit(&m->disconnections, memory_order_relaxed));
+  }
 
-  char *translated_str = NULL;
+  printf("\033[0m");
+  fflush(stdout);
+}
 
+void *stats_thread(void *arg) {
+  (void)arg;
   while (1) {
-    // Accept a new connection
-    if ((client_socket = accept(server_fd_italian_to_english,
-                                (struct sockaddr *)&client_addr, &addr_len)) <
-        0) {
-      if (errno == EINTR || errno == ECONNABORTED) {
-        continue;
-      } else {
-        perror("accept failed");
-        close(server_fd_italian_to_english);
-        exit(EXIT_FAILURE);
-      }
-      continue;
-    }
+    sleep(stats_interval);
+    print_server_stats();
+  }
+
+  return NULL;
+}
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+// Vocabulary reload
+//
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+// SIGHUP reloads every vocabulary without dropping a connection, SIGUSR1
+// applies the corrections file again. The signals are blocked in every thread
+// and taken here with sigwait, so loading runs on this thread while the
+// reactors and workers keep translating.
+void reload_signals(sigset_t *signals) {
+  sigemptyset(signals);
+  sigaddset(signals, SIGHUP);
+  sigaddset(signals, SIGUSR1);
+}
 
-    print_welcome_message(client_socket, 2);
+void *reload_thread(void *arg) {
+  (void)arg;
+  sigset_t signals;
+  reload_signals(&signals);
 
-    clientinfo *client_info = malloc(sizeof(clientinfo));
-    client_info->client_socket = client_socket;
-    client_info->vocabulary = v;
+  while (1) {
+    int sig;
+    if (sigwait(&signals, &sig) != 0) {
+      continue;
+    }
 
-    pthread_t client_thread;
-    if (pthread_create(&client_thread, NULL, handle_client_italian_to_english,
-                       (void *)client_info) != 0) {
-      perror("Failed to create client thread");
-      close(client_socket);
+    if (sig == SIGUSR1) {
+      int applied = corrections_apply(corrections_file);
+      if (applied < 0) {
+        perror("Error opening corrections file");
+      } else {
+        printf("%d corrections applied from %s\n", applied, corrections_file);
+      }
+      fflush(stdout);
       continue;
     }
 
-    pthread_detach(client_thread);
+    for (int i = 0; i < vocab_count; i++) {
+      vocab *v = vocabs[i];
+      if (vocab_reload(v) < 0) {
+        fprintf(stderr, "Failed to reload %s, keeping the one in use\n",
+                v->path);
+      } else {
+        vocab_print(v, " reloaded");
+      }
+    }
+    fflush(stdout);
   }
 
   return NULL;
 }
 // +++++++++++++++++++++++++++++++++++++++++++++++++++++++
 
-// Create thread for each room
-void room_creation(vocab *vocabulary) {
-  pthread_t th;
-  pthread_t th2;
+// Create the reactors, each one with its own accept shard for every room
+void room_creation() {
+  // Before any thread starts, they all inherit the mask
+  sigset_t signals;
+  reload_signals(&signals);
+  pthread_sigmask(SIG_BLOCK, &signals, NULL);
 
-  if (pthread_create(&th, NULL, room_english_to_italian, (void *)vocabulary) !=
-      0) {
-    perror("Failed to create thread room english to italian");
-    exit(EXIT_FAILURE);
+  if (reactor_count < 1) {
+    reactor_count = sysconf(_SC_NPROCESSORS_ONLN);
+  }
+  if (reactor_count < 1) {
+    reactor_count = 1;
   }
 
-  if (pthread_create(&th2, NULL, room_italian_to_english, (void *)vocabulary) !=
+  if (worker_count < 0) {
+    worker_count = sysconf(_SC_NPROCESSORS_ONLN);
+  }
+  if (worker_pool_init(&translation_pool, worker_count, worker_queue_size) <
       0) {
-    perror("Failed to create thread room italian to english");
+    perror("Failed to create translation workers");
     exit(EXIT_FAILURE);
   }
-
-  if (pthread_join(th, NULL) != 0) {
-    perror("Failed to join thread room english to italian");
+  if (translation_cache_size > 0 &&
+      cache_init(&translation_cache, translation_cache_size) < 0) {
+    perror("Failed to allocate translation cache");
     exit(EXIT_FAILURE);
   }
 
-  if (pthread_join(th2, NULL) != 0) {
-    perror("Failed to join thread room italian to english");
+  reactors = calloc(reactor_count, sizeof(reactor));
+  listeners = calloc(reactor_count * room_count, sizeof(room_listener));
+  if (reactors == NULL || listeners == NULL) {
+    perror("Failed to allocate reactors");
     exit(EXIT_FAILURE);
   }
-}
 
-int main() {
-  waiting_client_queue_english_to_italian = create_client_q();
-  waiting_client_queue_italian_to_english = create_client_q();
+  for (int i = 0; i < reactor_count; i++) {
+    if (reactor_init(&reactors[i], i, io_engine) < 0) {
+      if (io_engine != REACTOR_IO_URING) {
+        exit(EXIT_FAILURE);
+      }
 
-  struct sockaddr_in server_addr_english, server_addr_italian;
+      printf("io_uring is not available, falling back to epoll\n");
+      io_engine = REACTOR_EPOLL;
+      if (reactor_init(&reactors[i], i, io_engine) < 0) {
+        exit(EXIT_FAILURE);
+      }
+    }
+    reactors[i].backpressure = backpressure;
 
-  if ((server_fd_english_to_italian = socket(AF_INET, SOCK_STREAM, 0)) == 0) {
-    perror("socket failed for English to Italian");
-    exit(EXIT_FAILURE);
+    for (int j = 0; j < room_count; j++) {
+      room_listener *l = &listeners[i * room_count + j];
+      room_listener_init(l, &rooms[j], i);
+
+      if (reactor_add_listener(&reactors[i], &l->listener) < 0) {
+        perror("Failed to register listening socket");
+        exit(EXIT_FAILURE);
+      }
+    }
   }
-  if ((server_fd_italian_to_english = socket(AF_INET, SOCK_STREAM, 0)) == 0) {
-    perror("socket failed for Italian to English");
-    exit(EXIT_FAILURE);
+
+  printf("\033[0;36m");
+  printf("---------------------------------------------------------------------"
+         "-----------------------------------\n");
+  printf("TCP Chat Server is listening on:\n");
+  for (int i = 0; i < room_count; i++) {
+    printf("  port %d (%s Room, %d seats)\n", rooms[i].port, rooms[i].name,
+           rooms[i].capacity);
   }
+  printf("I/O engine: %s, %d accept shards per port, backlog %d\n",
+         reactor_engine_name(io_engine), reactor_count, listen_backlog);
+  printf("Output queue per client: %zu KiB high, %zu KiB low, slow clients "
+         "are %s\n",
+         backpressure.high_watermark / 1024, backpressure.low_watermark / 1024,
+         backpressure.policy == REACTOR_DISCONNECT ? "disconnected"
+                                                   : "dropped messages");
+  printf("Translation workers: %d, queue of %d jobs, tokenizer: %s\n",
+         translation_pool.worker_count, worker_queue_size, tokenizer_engine());
+  if (translation_cache_size > 0) {
+    printf("Translation cache: %zu KiB in %d shards, messages up to %d "
+           "bytes\n",
+           translation_cache_size / 1024, CACHE_SHARDS,
+           TRANSLATION_CACHE_MAX_MESSAGE);
+  } else {
+    printf("Translation cache: off\n");
+  }
+  for (int i = 0; i < vocab_count; i++) {
+    vocab_print(vocabs[i], "");
+  }
+  printf("Corrections: %s, SIGUSR1 applies it again, SIGHUP reloads the "
+         "vocabularies\n",
+         corrections_file);
+  printf("---------------------------------------------------------------------"
+         "-----------------------------------\n");
+  printf("\033[0m");
 
-  // Things for server shutdown
-  int opt = 1;
-  if (setsockopt(server_fd_english_to_italian, SOL_SOCKET, SO_REUSEADDR, &opt,
-                 sizeof(opt)) < 0) {
-    perror("setsockopt failed for English to Italian");
-    exit(EXIT_FAILURE);
+  for (int i = 0; i < reactor_count; i++) {
+    if (reactor_start(&reactors[i]) != 0) {
+      perror("Failed to create reactor thread");
+      exit(EXIT_FAILURE);
+    }
   }
-  if (setsockopt(server_fd_italian_to_english, SOL_SOCKET, SO_REUSEADDR, &opt,
-                 sizeof(opt)) < 0) {
-    perror("setsockopt failed for Italian to English");
-    exit(EXIT_FAILURE);
+
+  if (stats_interval > 0) {
+    pthread_t stats;
+    if (pthread_create(&stats, NULL, stats_thread, NULL) != 0) {
+      perror("Failed to create stats thread");
+    } else {
+      pthread_detach(stats);
+    }
   }
 
-  server_addr_english.sin_family = AF_INET;
-  server_addr_english.sin_addr.s_addr = INADDR_ANY;
-  server_addr_english.sin_port = htons(PORT_ENGLISH_TO_ITALIAN);
+  pthread_t reload;
+  if (pthread_create(&reload, NULL, reload_thread, NULL) != 0) {
+    perror("Failed to create vocabulary reload thread");
+  } else {
+    pthread_detach(reload);
+  }
 
-  server_addr_italian.sin_family = AF_INET;
-  server_addr_italian.sin_addr.s_addr = INADDR_ANY;
-  server_addr_italian.sin_port = htons(PORT_ITALIAN_TO_ENGLISH);
+  for (int i = 0; i < reactor_count; i++) {
+    if (pthread_join(reactors[i].thread, NULL) != 0) {
+      perror("Failed to join reactor thread");
+      exit(EXIT_FAILURE);
+    }
+    reactor_destroy(&reactors[i]);
+  }
 
-  if (bind(server_fd_english_to_italian,
-           (struct sockaddr *)&server_addr_english,
-           sizeof(server_addr_english)) < 0) {
-    perror("bind failed for English to Italian");
-    exit(EXIT_FAILURE);
+  for (int i = 0; i < reactor_count * room_count; i++) {
+    close(listeners[i].listener.handler.fd);
   }
-  if (bind(server_fd_italian_to_english,
-           (struct sockaddr *)&server_addr_italian,
-           sizeof(server_addr_italian)) < 0) {
-    perror("bind failed for Italian to English");
-    exit(EXIT_FAILURE);
+
+  free(listeners);
+  free(reactors);
+  worker_pool_destroy(&translation_pool);
+  if (translation_cache_size > 0) {
+    cache_destroy(&translation_cache);
   }
+}
 
-  if (listen(server_fd_english_to_italian, 3) < 0) {
-    perror("listen failed for English to Italian");
-    exit(EXIT_FAILURE);
+// "high,low" in KiB, low defaults to a quarter of high
+int parse_watermarks(const char *arg, reactor_backpressure *bp) {
+  int high = 0, low = -1;
+  if (sscanf(arg, "%d,%d", &high, &low) < 1 || high <= 0) {
+    return -1;
   }
-  if (listen(server_fd_italian_to_english, 3) < 0) {
-    perror("listen failed for Italian to English");
-    exit(EXIT_FAILURE);
+  if (low < 0) {
+    low = high / 4;
+  }
+  if (low > high) {
+    return -1;
   }
 
-  printf("\033[0;36m");
-  printf("---------------------------------------------------------------------"
-         "-----------------------------------\n");
-  printf("TCP Chat Server is listening on ports %d (English to Italian Room) "
-         "and %d (Italian to English Room)\n",
-         PORT_ENGLISH_TO_ITALIAN, PORT_ITALIAN_TO_ENGLISH);
-  printf("---------------------------------------------------------------------"
-         "-----------------------------------\n");
-  printf("\033[0m");
+  bp->high_watermark = (size_t)high * 1024;
+  bp->low_watermark = (size_t)low * 1024;
+  return 0;
+}
 
-  vocab *vocabulary = vocab_setup_from_txt();
+void print_usage(const char *program) {
+  printf("Usage: %s [-c rooms file] [-e epoll|io_uring] [-t threads] "
+         "[-b backlog] [-s seconds] [-w high,low] [-p drop|disconnect] "
+         "[-j workers] [-q jobs] [-m corrections file] [-k KiB]\n",
+         program);
+  printf("  -c  rooms to serve (default: %s)\n", ROOMS_FILE);
+  printf("  -e  I/O engine used by the reactors (default: epoll)\n");
+  printf("  -t  reactor threads, each one is an accept shard of every room "
+         "port (default: one per core)\n");
+  printf("  -b  listen backlog of every shard (default: %d)\n", SOMAXCONN);
+  printf("  -s  print server stats every given seconds (default: off)\n");
+  printf("  -w  output queued per client before it counts as slow, and what "
+         "dropping brings it back to, in KiB (default: %d,%d)\n",
+         REACTOR_HIGH_WATERMARK / 1024, REACTOR_LOW_WATERMARK / 1024);
+  printf("  -p  what to do with a slow client: drop its oldest messages or "
+         "disconnect it (default: drop)\n");
+  printf("  -j  translation worker threads, at least 1 (default: one per "
+         "core)\n");
+  printf("  -q  translation jobs queued before clients stop being read until "
+         "the workers catch up (default: 1024)\n");
+  printf("  -m  translations corrected while running, applied at startup and "
+         "on SIGUSR1 (default: %s)\n",
+         CORRECTIONS_FILE);
+  printf("  -k  translations of short messages kept for the next time they're "
+         "sent, in KiB, 0 is off (default: %d)\n",
+         TRANSLATION_CACHE_SIZE / 1024);
+}
 
-  room_creation(vocabulary);
+int main(int argc, char *argv[]) {
+  const char *rooms_file = ROOMS_FILE;
 
-  ht_del_hash_table(vocabulary->english_to_italian);
-  ht_del_hash_table(vocabulary->italian_to_english);
-  free(vocabulary);
+  int opt;
+  while ((opt = getopt(argc, argv, "c:e:t:b:s:w:p:j:q:m:k:h")) != -1) {
+    switch (opt) {
+    case 'c':
+      rooms_file = optarg;
+      break;
+    case 'e':
+      if (reactor_engine_from_name(optarg, &io_engine) < 0) {
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 't':
+      reactor_count = atoi(optarg);
+      break;
+    case 'b':
+      listen_backlog = atoi(optarg);
+      break;
+    case 's':
+      stats_interval = atoi(optarg);
+      break;
+    case 'w':
+      if (parse_watermarks(optarg, &backpressure) < 0) {
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'j':
+      worker_count = atoi(optarg);
+      break;
+    case 'q':
+      worker_queue_size = atoi(optarg);
+      break;
+    case 'm':
+      corrections_file = optarg;
+      break;
+    case 'k':
+      translation_cache_size = (size_t)atoi(optarg) * 1024;
+      break;
+    case 'p':
+      if (strcmp(optarg, "drop") == 0) {
+        backpressure.policy = REACTOR_DROP_OLDEST;
+      } else if (strcmp(optarg, "disconnect") == 0) {
+        backpressure.policy = REACTOR_DISCONNECT;
+      } else {
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    default:
+      print_usage(argv[0]);
+      exit(opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+  }
+
+  // A client closing its socket must not kill the server on the next send
+  signal(SIGPIPE, SIG_IGN);
+
+  if (rooms_setup_from_txt(rooms_file) < 0) {
+    fprintf(stderr, "No room to serve\n");
+    exit(EXIT_FAILURE);
+  }
+  // Optional, there are none until a moderator writes the file
+  corrections_apply(corrections_file);
+
+  room_creation();
+
+  for (int i = 0; i < room_count; i++) {
+    pthread_mutex_destroy(&rooms[i].mutex);
+  }
+  for (int i = 0; i < vocab_count; i++) {
+    vocab_free(vocabs[i]);
+  }
 
-  close(server_fd_english_to_italian);
-  close(server_fd_italian_to_english);
   return 0;
 }
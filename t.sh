@@ -0,0 +1,52 @@
+#!/bin/sh
+
+# Build the server, the tests and the benchmarks, run every test against one
+# server started with the rooms they expect (tests/test.h). Exits non-zero if
+# one failed. Benchmarks are run by hand.
+set -e
+
+DIR=$(mktemp -d)
+trap 'kill $SERVER 2>/dev/null; rm -rf $DIR' EXIT
+
+gcc -o ./vocab_compiler/vc ./vocab_compiler/vocab_compiler.c ./phash/phash.c ./phrase/phrase.c ./tokenizer/tokenizer.c ./hash_table/hash_table.c ./hash_table/hash_table_swiss.c ./bloom/bloom.c
+./vocab_compiler/vc ./server/vocab_compiled.c ./server/vocab.txt
+
+gcc $CFLAGS -o ./tests/s ./server/server.c ./cache/cache.c ./protocol/protocol.c ./hash_table/hash_table.c ./hash_table/hash_table_swiss.c ./bloom/bloom.c ./hash_table/hash_table_concurrent.c ./phash/phash.c ./phrase/phrase.c ./server/vocab_compiled.c ./reactor/reactor.c ./reactor/reactor_uring.c ./tokenizer/tokenizer.c ./worker_pool/worker_pool.c ./rcu/rcu.c -lm -lpthread
+
+gcc -O2 -o ./bench/worker_pool ./bench/worker_pool.c ./worker_pool/worker_pool.c -lpthread
+gcc -O2 -o ./bench/throughput ./bench/throughput.c ./tests/test.c ./protocol/protocol.c -lpthread
+gcc -O2 -o ./bench/hash_table ./bench/hash_table.c ./bench/bench.c ./hash_table/hash_table.c ./hash_table/hash_table_swiss.c ./bloom/bloom.c -lm
+gcc -O2 -DHT_SWISS -o ./bench/hash_table_swiss ./bench/hash_table.c ./bench/bench.c ./hash_table/hash_table.c ./hash_table/hash_table_swiss.c ./bloom/bloom.c -lm
+gcc -O2 -o ./bench/rehash ./bench/rehash.c ./bench/bench.c ./hash_table/hash_table.c ./hash_table/hash_table_swiss.c ./bloom/bloom.c -lm
+gcc -O2 -DHT_MIGRATE_SLOTS=1073741824 -o ./bench/rehash_whole ./bench/rehash.c ./bench/bench.c ./hash_table/hash_table.c ./hash_table/hash_table_swiss.c ./bloom/bloom.c -lm
+gcc -O2 -o ./bench/concurrent_table ./bench/concurrent_table.c ./bench/bench.c ./hash_table/hash_table.c ./hash_table/hash_table_swiss.c ./hash_table/hash_table_concurrent.c ./bloom/bloom.c ./rcu/rcu.c -lm -lpthread
+gcc -O2 -o ./bench/bloom ./bench/bloom.c ./bench/bench.c ./hash_table/hash_table.c ./hash_table/hash_table_swiss.c ./bloom/bloom.c -lm
+
+TESTS="backpressure commands corrections reload"
+for t in $TESTS; do
+  gcc -o ./tests/$t ./tests/$t.c ./tests/test.c ./protocol/protocol.c -lpthread
+done
+
+cat > $DIR/rooms.txt <<ROOMS
+Forward,18080,./server/vocab.txt,forward,100
+Reverse,18081,./server/vocab.txt,reverse,100
+Reload,18082,$DIR/reload.txt,forward,100
+ROOMS
+printf 'Hello,Ciao\nThing,Cosa\n' > $DIR/reload.txt
+touch $DIR/corrections.txt
+
+./tests/s -c $DIR/rooms.txt -m $DIR/corrections.txt -e ${ENGINE:-epoll} > $DIR/server.log 2>&1 &
+SERVER=$!
+sleep 1
+
+export TEST_SERVER_PID=$SERVER TEST_DIR=$DIR
+FAILED=0
+for t in $TESTS; do
+  if ./tests/$t; then
+    echo "ok $t"
+  else
+    echo "FAILED $t"
+    FAILED=1
+  fi
+done
+exit $FAILED
@@ -0,0 +1,95 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "test.h"
+
+// One client pipelines chat messages as fast as the socket takes them while
+// reading every answer, so only the translation jobs queued for it can pile
+// up in the server. They're capped: the server stops reading the client and
+// its memory stays bounded however long the flood lasts.
+
+#define FLOOD_SECONDS 3
+#define FLOOD_BATCH 16 // frames per send
+#define MAX_GROWTH (32 * 1024) // KiB
+#define FLOOD_USERNAME "flooder"
+
+static double now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void *drain(void *arg) {
+  test_client *c = arg;
+  char buffer[65536];
+  while (recv(c->fd, buffer, sizeof(buffer), 0) > 0) {
+  }
+  return NULL;
+}
+
+int main() {
+  const long rss_before = test_server_rss();
+
+  char body[PROTO_MAX_BODY];
+  for (size_t i = 0; i + 12 < sizeof(body); i += 12) {
+    memcpy(body + i, "hello thing ", 12);
+  }
+  body[1000] = '\0';
+
+  char batch[FLOOD_BATCH * PROTO_MAX_FRAME];
+  size_t batch_len = 0;
+  for (int i = 0; i < FLOOD_BATCH; i++) {
+    batch_len += proto_encode(batch + batch_len, sizeof(batch) - batch_len,
+                              PROTO_CHAT, 0, FLOOD_USERNAME,
+                              strlen(FLOOD_USERNAME), body, strlen(body));
+  }
+
+  test_client *flooder = test_connect(TEST_PORT_FORWARD);
+  pthread_t reader;
+  pthread_create(&reader, NULL, drain, flooder);
+
+  long rss_max = rss_before;
+  size_t sent = 0, offset = 0;
+  const double start = now();
+  double sampled = start;
+  while (now() - start < FLOOD_SECONDS) {
+    ssize_t n = send(flooder->fd, batch + offset, batch_len - offset,
+                     MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (n > 0) {
+      sent += n;
+      offset = (offset + n) % batch_len;
+    } else {
+      TEST_CHECK(errno == EAGAIN || errno == EWOULDBLOCK, "send failed");
+      usleep(1000);
+    }
+
+    if (now() - sampled > 0.05) {
+      long rss = test_server_rss();
+      rss_max = rss > rss_max ? rss : rss_max;
+      sampled = now();
+    }
+  }
+
+  printf("%zu KiB sent in %d s, server memory %ld KiB, at most %ld KiB\n",
+         sent / 1024, FLOOD_SECONDS, rss_before, rss_max);
+  TEST_CHECK(rss_max - rss_before < MAX_GROWTH,
+             "server memory grew by %ld KiB during the flood",
+             rss_max - rss_before);
+
+  shutdown(flooder->fd, SHUT_RDWR);
+  pthread_join(reader, NULL);
+  test_close(flooder);
+
+  // Still serving everyone else
+  char out[PROTO_MAX_BODY + 1];
+  test_client *c = test_connect(TEST_PORT_FORWARD);
+  test_translate(c, "hello", out, sizeof(out));
+  TEST_CHECK(strcmp(out, "ciao") == 0, "hello gave \"%s\"", out);
+  test_close(c);
+  return 0;
+}
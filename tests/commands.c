@@ -0,0 +1,30 @@
+#include <string.h>
+
+#include "test.h"
+
+// Commands start with '/' and are read by the client and the server, not by
+// people: they go out untranslated whatever the room ("/ciao" to a room
+// translating Italian used to come back as "/hello").
+
+int main() {
+  char out[PROTO_MAX_BODY + 1];
+
+  test_client *forward = test_connect(TEST_PORT_FORWARD);
+  test_translate(forward, "/hello", out, sizeof(out));
+  TEST_CHECK(strcmp(out, "/hello") == 0, "/hello gave \"%s\"", out);
+
+  // Only the command, the next message is translated again
+  test_translate(forward, "hello", out, sizeof(out));
+  TEST_CHECK(strcmp(out, "ciao") == 0, "hello gave \"%s\"", out);
+  test_close(forward);
+
+  test_client *reverse = test_connect(TEST_PORT_REVERSE);
+  test_translate(reverse, "/ciao", out, sizeof(out));
+  TEST_CHECK(strcmp(out, "/ciao") == 0, "/ciao gave \"%s\"", out);
+
+  // And the server still takes it for leaving the room
+  TEST_CHECK(test_receive(reverse, TEST_USERNAME, out, sizeof(out)) < 0,
+             "still connected after /ciao");
+  test_close(reverse);
+  return 0;
+}
@@ -0,0 +1,55 @@
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "test.h"
+
+// A correction sent with SIGUSR1 changes translations while the server runs,
+// phrases included: one the vocabulary has ("Va bene" is "Alright") and one
+// it hasn't ("All right").
+
+#define CORRECTION_WAIT_US (5 * 1000 * 1000)
+#define CORRECTION_POLL_US (50 * 1000)
+
+// Translate body until it gives expected, the server applies corrections
+// on its own time
+static void expect_corrected(test_client *c, const char *body,
+                             const char *expected) {
+  char out[PROTO_MAX_BODY + 1];
+  for (long waited = 0;; waited += CORRECTION_POLL_US) {
+    test_translate(c, body, out, sizeof(out));
+    if (strcmp(out, expected) == 0) {
+      return;
+    }
+    TEST_CHECK(waited < CORRECTION_WAIT_US, "%s gave \"%s\", not \"%s\"", body,
+               out, expected);
+    usleep(CORRECTION_POLL_US);
+  }
+}
+
+int main() {
+  char out[PROTO_MAX_BODY + 1];
+  test_client *reverse = test_connect(TEST_PORT_REVERSE);
+  test_client *forward = test_connect(TEST_PORT_FORWARD);
+
+  test_translate(reverse, "Va bene", out, sizeof(out));
+  TEST_CHECK(strcmp(out, "Alright") == 0, "Va bene gave \"%s\"", out);
+
+  char path[512];
+  snprintf(path, sizeof(path), "%s/corrections.txt", test_dir());
+  FILE *file = fopen(path, "w");
+  TEST_CHECK(file != NULL, "cannot write %s", path);
+  fputs("./server/vocab.txt,All right,Va bene\n", file);
+  fclose(file);
+  TEST_CHECK(kill(test_server_pid(), SIGUSR1) == 0,
+             "cannot signal the server");
+
+  expect_corrected(reverse, "Va bene", "All right");
+  expect_corrected(reverse, "ok, va bene!", "ok, all right!");
+  expect_corrected(forward, "All right", "Va bene");
+
+  test_close(forward);
+  test_close(reverse);
+  return 0;
+}
@@ -0,0 +1,112 @@
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "test.h"
+
+// Clients pipeline messages to a room while its vocabulary is rewritten and
+// reloaded every few milliseconds, alternating two versions that translate
+// every word differently. The snapshot a translation reads is swapped under
+// it, never changed: every message must come back entirely from one version.
+
+#define RELOAD_SECONDS 3
+#define RELOAD_INTERVAL_US 2000
+#define RELOAD_CLIENTS 4
+#define RELOAD_PIPELINE 32 // messages sent before reading the answers
+
+static const char *versions[] = {"Hello,Ciao\nThing,Cosa\n",
+                                 "Hello,Salve\nThing,Roba\n"};
+static const char *expected[] = {"ciao cosa %d ciao cosa",
+                                 "salve roba %d salve roba"};
+
+static atomic_int stopping;
+static atomic_long translated[2];
+
+static void write_version(const char *path, int version) {
+  char next[512];
+  snprintf(next, sizeof(next), "%s.new", path);
+
+  // Renamed over the old file: a reload reads one version or the other
+  FILE *file = fopen(next, "w");
+  TEST_CHECK(file != NULL, "cannot write %s", next);
+  fputs(versions[version], file);
+  fclose(file);
+  TEST_CHECK(rename(next, path) == 0, "cannot rename %s", next);
+}
+
+static void *client(void *arg) {
+  const int id = (int)(long)arg;
+  char username[32], body[64], out[PROTO_MAX_BODY + 1];
+  snprintf(username, sizeof(username), "reader%d", id);
+
+  test_client *c = test_connect(TEST_PORT_RELOAD);
+  int sequence = 0;
+  while (!atomic_load(&stopping)) {
+    // Numbers differ, no answer comes from the translation cache
+    for (int i = 0; i < RELOAD_PIPELINE; i++) {
+      snprintf(body, sizeof(body), "hello thing %d hello thing",
+               sequence + i);
+      test_send(c, username, body);
+    }
+
+    for (int i = 0; i < RELOAD_PIPELINE; i++) {
+      TEST_CHECK(test_receive(c, username, out, sizeof(out)) >= 0,
+                 "connection closed during the reloads");
+
+      int version = 0;
+      while (version < 2) {
+        snprintf(body, sizeof(body), expected[version], sequence + i);
+        if (strcmp(out, body) == 0) {
+          break;
+        }
+        version++;
+      }
+      TEST_CHECK(version < 2, "\"%s\" mixes both vocabularies", out);
+      atomic_fetch_add(&translated[version], 1);
+    }
+    sequence += RELOAD_PIPELINE;
+  }
+
+  test_close(c);
+  return NULL;
+}
+
+int main() {
+  char path[512];
+  snprintf(path, sizeof(path), "%s/reload.txt", test_dir());
+  const pid_t server = test_server_pid();
+
+  pthread_t clients[RELOAD_CLIENTS];
+  for (long i = 0; i < RELOAD_CLIENTS; i++) {
+    pthread_create(&clients[i], NULL, client, (void *)i);
+  }
+
+  int reloads = 0;
+  const time_t end = time(NULL) + RELOAD_SECONDS;
+  while (time(NULL) < end) {
+    write_version(path, ++reloads % 2);
+    TEST_CHECK(kill(server, SIGHUP) == 0, "cannot signal the server");
+    usleep(RELOAD_INTERVAL_US);
+  }
+
+  atomic_store(&stopping, 1);
+  for (int i = 0; i < RELOAD_CLIENTS; i++) {
+    pthread_join(clients[i], NULL);
+  }
+
+  // Back to the version t.sh wrote
+  write_version(path, 0);
+  kill(server, SIGHUP);
+
+  const long first = atomic_load(&translated[0]);
+  const long second = atomic_load(&translated[1]);
+  printf("%d reloads, %ld messages from the first version, %ld from the "
+         "second\n",
+         reloads, first, second);
+  TEST_CHECK(first > 0 && second > 0, "a reload was never seen");
+  return 0;
+}
@@ -0,0 +1,138 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "test.h"
+
+#define TEST_TIMEOUT_SECONDS 10
+
+void test_fail(const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  fprintf(stderr, "FAIL: ");
+  vfprintf(stderr, format, args);
+  fprintf(stderr, "\n");
+  va_end(args);
+  exit(EXIT_FAILURE);
+}
+
+pid_t test_server_pid() {
+  const char *pid = getenv("TEST_SERVER_PID");
+  TEST_CHECK(pid != NULL, "TEST_SERVER_PID is not set, run the tests by t.sh");
+  return (pid_t)atol(pid);
+}
+
+const char *test_dir() {
+  const char *dir = getenv("TEST_DIR");
+  TEST_CHECK(dir != NULL, "TEST_DIR is not set, run the tests by t.sh");
+  return dir;
+}
+
+long test_server_rss() {
+  char path[64], line[256];
+  snprintf(path, sizeof(path), "/proc/%d/status", (int)test_server_pid());
+  FILE *file = fopen(path, "r");
+  TEST_CHECK(file != NULL, "no server process at %s", path);
+
+  long rss = -1;
+  while (fgets(line, sizeof(line), file) != NULL) {
+    if (sscanf(line, "VmRSS: %ld kB", &rss) == 1) {
+      break;
+    }
+  }
+  fclose(file);
+  return rss;
+}
+
+test_client *test_connect(int port) {
+  test_client *c = malloc(sizeof(test_client));
+  TEST_CHECK(c != NULL, "out of memory");
+
+  c->fd = socket(AF_INET, SOCK_STREAM, 0);
+  TEST_CHECK(c->fd >= 0, "socket failed");
+
+  // A server that stops answering fails the test instead of hanging it
+  struct timeval timeout = {TEST_TIMEOUT_SECONDS, 0};
+  setsockopt(c->fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  struct sockaddr_in address = {0};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  TEST_CHECK(connect(c->fd, (struct sockaddr *)&address, sizeof(address)) ==
+                 0,
+             "cannot connect to port %d", port);
+
+  proto_parser_init(&c->parser);
+  c->pending_start = 0;
+  c->pending_len = 0;
+  return c;
+}
+
+void test_close(test_client *c) {
+  close(c->fd);
+  free(c);
+}
+
+void test_send(test_client *c, const char *username, const char *body) {
+  char frame[PROTO_MAX_FRAME];
+  size_t len = proto_encode(frame, sizeof(frame), PROTO_CHAT, 0, username,
+                            strlen(username), body, strlen(body));
+  TEST_CHECK(len > 0, "message too long: %s", body);
+
+  for (size_t sent = 0; sent < len;) {
+    ssize_t n = send(c->fd, frame + sent, len - sent, MSG_NOSIGNAL);
+    TEST_CHECK(n > 0, "send failed");
+    sent += n;
+  }
+}
+
+long test_receive(test_client *c, const char *username, char *body,
+                  size_t size) {
+  const size_t username_len = strlen(username);
+
+  while (1) {
+    proto_frame frame;
+    int res;
+    while ((res = proto_parser_next(&c->parser, &frame)) > 0) {
+      if (frame.type != PROTO_CHAT || frame.username_len != username_len ||
+          memcmp(frame.username, username, username_len) != 0) {
+        continue;
+      }
+
+      TEST_CHECK(frame.body_len < size, "message of %zu bytes too long",
+                 frame.body_len);
+      memcpy(body, frame.body, frame.body_len);
+      body[frame.body_len] = '\0';
+      return (long)frame.body_len;
+    }
+    TEST_CHECK(res == 0, "server sent a malformed frame");
+
+    if (c->pending_len == 0) {
+      ssize_t n = recv(c->fd, c->pending, sizeof(c->pending), 0);
+      if (n <= 0) {
+        return -1;
+      }
+      c->pending_start = 0;
+      c->pending_len = (size_t)n;
+    }
+
+    size_t taken = proto_parser_feed(
+        &c->parser, c->pending + c->pending_start, c->pending_len);
+    c->pending_start += taken;
+    c->pending_len -= taken;
+  }
+}
+
+void test_translate(test_client *c, const char *body, char *out,
+                    size_t size) {
+  test_send(c, TEST_USERNAME, body);
+  TEST_CHECK(test_receive(c, TEST_USERNAME, out, size) >= 0,
+             "no translation of \"%s\"", body);
+}
@@ -0,0 +1,57 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "../protocol/protocol.h"
+
+// What the tests share: every test is a program talking to one server that
+// t.sh started with the rooms below, failing with a message and a non-zero
+// exit status. The server's pid and the directory of its files (rooms,
+// corrections, vocabularies the tests may rewrite) are in the environment.
+
+#define TEST_PORT_FORWARD 18080 // ./server/vocab.txt, English to Italian
+#define TEST_PORT_REVERSE 18081 // ./server/vocab.txt, Italian to English
+#define TEST_PORT_RELOAD 18082  // reload.txt in the test directory, forward
+
+#define TEST_USERNAME "tester"
+
+typedef struct {
+  int fd;
+  proto_parser parser;
+  char pending[4096]; // received, not fed to the parser yet
+  size_t pending_start;
+  size_t pending_len;
+} test_client;
+
+// Print what failed and exit
+void test_fail(const char *format, ...);
+
+#define TEST_CHECK(condition, ...)                                            \
+  do {                                                                        \
+    if (!(condition)) {                                                       \
+      test_fail(__VA_ARGS__);                                                 \
+    }                                                                         \
+  } while (0)
+
+pid_t test_server_pid();
+const char *test_dir();
+
+// Resident memory of the server, in KiB
+long test_server_rss();
+
+test_client *test_connect(int port);
+void test_close(test_client *c);
+
+void test_send(test_client *c, const char *username, const char *body);
+
+// Next chat message of username, the ones of others are skipped. Returns the
+// body length, -1 when the connection closed.
+long test_receive(test_client *c, const char *username, char *body,
+                  size_t size);
+
+// Send body and wait for its translation, NUL terminated in out
+void test_translate(test_client *c, const char *body, char *out, size_t size);
+
+#endif // TEST_H
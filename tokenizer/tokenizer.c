@@ -0,0 +1,129 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "tokenizer.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define TOKENIZER_BLOCK 16
+
+// Blocks
+//
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+// One bit per byte of a block of 16, bit i set when byte i is a word byte
+#if defined(__SSE2__)
+
+// Compares are signed: bytes from 0x80 up are negative, so they're never
+// ASCII letters or digits, and the movemask of the block itself catches them
+static inline uint32_t tokenizer_block_words(const char *p) {
+  const __m128i v = _mm_loadu_si128((const __m128i *)p);
+  const __m128i folded = _mm_or_si128(v, _mm_set1_epi8(0x20));
+
+  const __m128i letters =
+      _mm_and_si128(_mm_cmpgt_epi8(folded, _mm_set1_epi8('a' - 1)),
+                    _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), folded));
+  const __m128i digits =
+      _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                    _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), v));
+  const __m128i apostrophes = _mm_cmpeq_epi8(v, _mm_set1_epi8('\''));
+
+  const __m128i ascii =
+      _mm_or_si128(_mm_or_si128(letters, digits), apostrophes);
+  return (uint32_t)(_mm_movemask_epi8(ascii) | _mm_movemask_epi8(v));
+}
+
+#define TOKENIZER_ENGINE "sse2"
+
+#else
+
+#define TOKENIZER_LSBS 0x0101010101010101ULL
+#define TOKENIZER_MSBS 0x8080808080808080ULL
+#define TOKENIZER_LOW7 0x7f7f7f7f7f7f7f7fULL
+
+// The high bit of every byte of m, packed into the low 8 bits
+static inline uint32_t tokenizer_word_bits(uint64_t m) {
+  return (uint32_t)(((m >> 7) * 0x0102040810204080ULL) >> 56);
+}
+
+// High bit set in every byte of low (7 bits each) between lo and hi: adding
+// sets it from lo up, or past hi, and never carries into the next byte
+static inline uint64_t tokenizer_range(const uint64_t low, const uint8_t lo,
+                                       const uint8_t hi) {
+  return (low + TOKENIZER_LSBS * (0x80 - lo)) &
+         ~(low + TOKENIZER_LSBS * (0x7f - hi)) & TOKENIZER_MSBS;
+}
+
+static inline uint64_t tokenizer_word_match(const char *p) {
+  uint64_t w;
+  memcpy(&w, p, 8);
+
+  const uint64_t low = w & TOKENIZER_LOW7;
+  const uint64_t letters = tokenizer_range(low | (TOKENIZER_LSBS * 0x20), 'a',
+                                           'z');
+  const uint64_t digits = tokenizer_range(low, '0', '9');
+  const uint64_t not_apostrophe =
+      (low ^ (TOKENIZER_LSBS * '\'')) + TOKENIZER_LOW7;
+
+  // Bytes with the high bit set are UTF-8, word bytes whatever low says
+  return ((letters | digits | ~not_apostrophe) & TOKENIZER_MSBS) |
+         (w & TOKENIZER_MSBS);
+}
+
+static inline uint32_t tokenizer_block_words(const char *p) {
+  return tokenizer_word_bits(tokenizer_word_match(p)) |
+         tokenizer_word_bits(tokenizer_word_match(p + 8)) << 8;
+}
+
+#define TOKENIZER_ENGINE "64-bit words"
+
+#endif // __SSE2__
+
+// The last block of a message is padded with NULs, never word bytes, so the
+// loads stay inside it
+static inline uint32_t tokenizer_words(const char *p, const char *end) {
+  if (end - p >= TOKENIZER_BLOCK) {
+    return tokenizer_block_words(p);
+  }
+
+  char block[TOKENIZER_BLOCK] = {0};
+  memcpy(block, p, end - p);
+  return tokenizer_block_words(block);
+}
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+// Words start at a word byte after a byte that isn't, and end at the first
+// byte that isn't: shifting the mask by one lines every byte up with the one
+// before it, carried over from the previous block. The bits are walked
+// without branching on every byte, starts then ends, the nth end closes the
+// nth word.
+size_t tokenizer_split(const char *data, size_t len, token *tokens) {
+  const char *end = data + len;
+  size_t starts = 0, ends = 0;
+  uint32_t previous = 0; // last byte of the previous block was a word byte
+
+  for (const char *block = data; block < end; block += TOKENIZER_BLOCK) {
+    const uint32_t words = tokenizer_words(block, end);
+    const uint32_t before = (words << 1 | previous) & 0xffff;
+    const uint32_t offset = (uint32_t)(block - data);
+    previous = words >> (TOKENIZER_BLOCK - 1);
+
+    for (uint32_t m = words & ~before; m != 0; m &= m - 1) {
+      tokens[starts++].start = offset + __builtin_ctz(m);
+    }
+    for (uint32_t m = ~words & before; m != 0; m &= m - 1) {
+      tokens[ends].len = offset + __builtin_ctz(m) - tokens[ends].start;
+      ends++;
+    }
+  }
+
+  // A word running into the end of a message filling its last block
+  if (ends < starts) {
+    tokens[ends].len = (uint32_t)len - tokens[ends].start;
+  }
+  return starts;
+}
+
+const char *tokenizer_engine() { return TOKENIZER_ENGINE; }
@@ -0,0 +1,31 @@
+#ifndef TOKENIZER_H
+#define TOKENIZER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Splits a chat message into words, 16 bytes at a time: every block is
+// classified once into a mask of word bytes, words are found in the mask.
+// Word bytes are ASCII letters and digits, the apostrophe (don't, l'amico)
+// and every byte of a UTF-8 sequence (è, ü); anything else, whitespace or
+// punctuation, is between words. The message is only read: no NUL needed,
+// nothing copied.
+//
+// The bytes between two words aren't tokens, they're the ones from the end
+// of a word to the start of the next: "Hello, you!" gives Hello and you, and
+// a translation puts ", " and "!" back around them.
+typedef struct {
+  uint32_t start; // offset in the message
+  uint32_t len;
+} token;
+
+// Words are at least one byte apart, a message never has more than this
+#define TOKENIZER_MAX_TOKENS(len) ((len) / 2 + 1)
+
+// Fill tokens, room for TOKENIZER_MAX_TOKENS(len) of them, with the words of
+// the message in order. Returns how many.
+size_t tokenizer_split(const char *data, size_t len, token *tokens);
+
+const char *tokenizer_engine();
+
+#endif // TOKENIZER_H
@@ -0,0 +1,551 @@
+// Compile vocabulary files into a minimal perfect hash of both directions of
+// each one, either as a C source file linked into the server:
+//
+//   ./vocab_compiler/vc ./server/vocab_compiled.c ./server/vocab.txt
+//
+// or as a binary dictionary the server maps read-only:
+//
+//   ./vocab_compiler/vc -b ./server/vocab.dict ./server/vocab.txt
+//
+// Either way a room starts without parsing its vocabulary and without
+// allocating a single entry. Only the phrases, keys of more than one word,
+// are listed for the server to build their trie.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../hash_table/hash_table.h"
+#include "../phash/phash.h"
+#include "../phrase/phrase.h"
+
+#define MAX_LENGTH 1000
+
+typedef struct {
+  char **keys;
+  char **values;
+  size_t count;
+  size_t capacity;
+} pair_list;
+
+// Every string once, NUL terminated, offset 0 is never used
+typedef struct {
+  char *data;
+  size_t len;
+  size_t capacity;
+  ht_hash_table *offsets; // string -> its offset, in decimal
+} string_pool;
+
+void *xrealloc(void *p, size_t size) {
+  p = realloc(p, size);
+  if (p == NULL) {
+    perror("Failed to allocate");
+    exit(EXIT_FAILURE);
+  }
+  return p;
+}
+
+ht_hash_table *xht_new() {
+  ht_hash_table *ht = ht_new();
+  if (ht == NULL) {
+    perror("Failed to allocate");
+    exit(EXIT_FAILURE);
+  }
+  return ht;
+}
+
+void xht_insert(ht_hash_table *ht, const char *key, const char *value) {
+  if (ht_insert(ht, key, value) < 0) {
+    perror("Failed to allocate");
+    exit(EXIT_FAILURE);
+  }
+}
+
+char *xstrdup(const char *s) {
+  char *copy = strdup(s);
+  if (copy == NULL) {
+    perror("Failed to allocate");
+    exit(EXIT_FAILURE);
+  }
+  return copy;
+}
+
+void pair_list_add(pair_list *l, const char *key, const char *value) {
+  if (l->count == l->capacity) {
+    l->capacity = l->capacity > 0 ? l->capacity * 2 : 1024;
+    l->keys = xrealloc(l->keys, l->capacity * sizeof(char *));
+    l->values = xrealloc(l->values, l->capacity * sizeof(char *));
+  }
+  l->keys[l->count] = xstrdup(key);
+  l->values[l->count] = xstrdup(value);
+  l->count++;
+}
+
+void pair_list_free(pair_list *l) {
+  for (size_t i = 0; i < l->count; i++) {
+    free(l->keys[i]);
+    free(l->values[i]);
+  }
+  free(l->keys);
+  free(l->values);
+}
+
+uint32_t string_pool_add(string_pool *p, const char *s) {
+  const char *known = ht_search(p->offsets, s);
+  if (known != NULL) {
+    return (uint32_t)strtoul(known, NULL, 10);
+  }
+
+  size_t len = strlen(s) + 1;
+  if (p->len + len > UINT32_MAX) {
+    fprintf(stderr, "Vocabulary too big\n");
+    exit(EXIT_FAILURE);
+  }
+  if (p->len + len > p->capacity) {
+    while (p->len + len > p->capacity) {
+      p->capacity = p->capacity > 0 ? p->capacity * 2 : 4096;
+    }
+    p->data = xrealloc(p->data, p->capacity);
+  }
+
+  uint32_t offset = (uint32_t)p->len;
+  memcpy(p->data + offset, s, len);
+  p->len += len;
+
+  char number[16];
+  snprintf(number, sizeof(number), "%u", offset);
+  xht_insert(p->offsets, s, number);
+  return offset;
+}
+
+// Same parsing as the server: "source,target" per line, keys folded so the
+// server looks words up in any case, a later line wins over an earlier one
+// with the same key
+int read_vocab(const char *path, pair_list *forward, pair_list *reverse) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    perror("Error opening file");
+    return -1;
+  }
+
+  pair_list lines = {0};
+  char line[MAX_LENGTH];
+  while (fgets(line, MAX_LENGTH, file) != NULL) {
+    line[strcspn(line, "\n")] = 0;
+
+    char *first_word = strtok(line, ",");
+    if (first_word != NULL) {
+      char *second_word = strtok(NULL, ",");
+      if (second_word != NULL) {
+        pair_list_add(&lines, first_word, second_word);
+      }
+    }
+  }
+  fclose(file);
+
+  // Walk backwards so the last line of every key is the one kept
+  ht_hash_table *seen_forward = xht_new();
+  ht_hash_table *seen_reverse = xht_new();
+  char key[MAX_LENGTH];
+  for (size_t i = lines.count; i-- > 0;) {
+    ht_fold_key(key, lines.keys[i]);
+    if (ht_search(seen_forward, key) == NULL) {
+      xht_insert(seen_forward, key, "");
+      pair_list_add(forward, key, lines.values[i]);
+    }
+    ht_fold_key(key, lines.values[i]);
+    if (ht_search(seen_reverse, key) == NULL) {
+      xht_insert(seen_reverse, key, "");
+      pair_list_add(reverse, key, lines.keys[i]);
+    }
+  }
+
+  ht_del_hash_table(seen_forward);
+  ht_del_hash_table(seen_reverse);
+  pair_list_free(&lines);
+  return 0;
+}
+
+// Output
+//
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+// One character inside a C string literal, returns the columns it took
+int write_escaped_char(FILE *out, unsigned char ch) {
+  if (ch == '"' || ch == '\\') {
+    return fprintf(out, "\\%c", ch);
+  } else if (ch >= 0x20 && ch < 0x7f && ch != '?') {
+    fputc(ch, out);
+    return 1;
+  }
+  // Always 3 digits, so a digit after it can't be read as part of it
+  return fprintf(out, "\\%03o", ch);
+}
+
+void write_string_literal(FILE *out, const char *data, size_t len) {
+  size_t column = 0;
+  fprintf(out, "    \"");
+
+  for (size_t i = 0; i < len; i++) {
+    if (column >= 70) {
+      fprintf(out, "\"\n    \"");
+      column = 0;
+    }
+    column += write_escaped_char(out, (unsigned char)data[i]);
+  }
+
+  fprintf(out, "\"");
+}
+
+// One direction of a vocabulary, hashed
+typedef struct {
+  uint32_t count;
+  uint32_t buckets;
+  uint32_t *displacements;
+  phash_entry *entries;
+  uint32_t *phrases; // entries whose key is a phrase
+  uint32_t phrase_count;
+} compiled_table;
+
+int compile_table(pair_list *pairs, string_pool *pool, compiled_table *t) {
+  uint32_t count = (uint32_t)pairs->count;
+  uint64_t *hashes = xrealloc(NULL, (count + 1) * sizeof(uint64_t));
+  for (uint32_t i = 0; i < count; i++) {
+    hashes[i] = phash_key_hash(pairs->keys[i], strlen(pairs->keys[i]));
+  }
+
+  uint32_t *slots;
+  if (phash_build(hashes, count, &t->buckets, &t->displacements, &slots) <
+      0) {
+    free(hashes);
+    return -1;
+  }
+
+  t->count = count;
+  t->entries = xrealloc(NULL, (count + 1) * sizeof(phash_entry));
+  t->phrases = xrealloc(NULL, (count + 1) * sizeof(uint32_t));
+  t->phrase_count = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    phash_entry *e = &t->entries[slots[i]];
+    e->hash = hashes[i];
+    e->key = string_pool_add(pool, pairs->keys[i]);
+    e->value = string_pool_add(pool, pairs->values[i]);
+
+    token words[PHRASE_MAX_WORDS];
+    if (phrase_key_words(pairs->keys[i], strlen(pairs->keys[i]), words) > 0) {
+      t->phrases[t->phrase_count++] = slots[i];
+    }
+  }
+
+  free(hashes);
+  free(slots);
+  return 0;
+}
+
+void write_table(FILE *out, int index, const char *direction,
+                 const compiled_table *t) {
+  fprintf(out, "static const uint32_t vocab_%d_%s_displacements[] = {\n",
+          index, direction);
+  for (uint32_t b = 0; b < t->buckets; b++) {
+    fprintf(out, "    %u,\n", t->displacements[b]);
+  }
+  fprintf(out, "};\n\n");
+
+  fprintf(out, "static const phash_entry vocab_%d_%s_entries[] = {\n", index,
+          direction);
+  for (uint32_t i = 0; i < t->count; i++) {
+    fprintf(out, "    {0x%016llxULL, %u, %u},\n",
+            (unsigned long long)t->entries[i].hash, t->entries[i].key,
+            t->entries[i].value);
+  }
+  if (t->count == 0) {
+    fprintf(out, "    {0, 0, 0},\n");
+  }
+  fprintf(out, "};\n\n");
+
+  fprintf(out, "static const uint32_t vocab_%d_%s_phrases[] = {\n", index,
+          direction);
+  for (uint32_t i = 0; i < t->phrase_count; i++) {
+    fprintf(out, "    %u,\n", t->phrases[i]);
+  }
+  if (t->phrase_count == 0) {
+    fprintf(out, "    0,\n");
+  }
+  fprintf(out, "};\n\n");
+}
+
+void write_table_initializer(FILE *out, int index, const char *direction,
+                             const compiled_table *t) {
+  fprintf(out,
+          "     {%u, %u, vocab_%d_%s_displacements, vocab_%d_%s_entries, "
+          "vocab_%d_strings, sizeof(vocab_%d_strings), vocab_%d_%s_phrases, "
+          "%u}",
+          t->count, t->buckets, index, direction, index, direction, index,
+          index, index, direction, t->phrase_count);
+}
+
+// Both directions of one vocabulary file, hashed, sharing one string pool
+typedef struct {
+  const char *path;
+  struct stat st;
+  pair_list forward;
+  pair_list reverse;
+  string_pool pool;
+  compiled_table source_to_target;
+  compiled_table target_to_source;
+} compiled_vocab;
+
+void compiled_vocab_free(compiled_vocab *v) {
+  free(v->source_to_target.displacements);
+  free(v->source_to_target.entries);
+  free(v->source_to_target.phrases);
+  free(v->target_to_source.displacements);
+  free(v->target_to_source.entries);
+  free(v->target_to_source.phrases);
+  pair_list_free(&v->forward);
+  pair_list_free(&v->reverse);
+  free(v->pool.data);
+  ht_del_hash_table(v->pool.offsets);
+}
+
+int compile_vocab(const char *path, compiled_vocab *v) {
+  memset(v, 0, sizeof(*v));
+  v->path = path;
+  if (stat(path, &v->st) < 0) {
+    perror("Error opening file");
+    return -1;
+  }
+
+  if (read_vocab(path, &v->forward, &v->reverse) < 0) {
+    return -1;
+  }
+
+  v->pool.offsets = xht_new();
+  string_pool_add(&v->pool, "");
+
+  if (compile_table(&v->forward, &v->pool, &v->source_to_target) < 0 ||
+      compile_table(&v->reverse, &v->pool, &v->target_to_source) < 0) {
+    compiled_vocab_free(v);
+    return -1;
+  }
+
+  printf("%s: %zu words, %zu reverse words (%u and %u phrases), %zu bytes "
+         "of strings\n",
+         path, v->forward.count, v->reverse.count,
+         v->source_to_target.phrase_count, v->target_to_source.phrase_count,
+         v->pool.len);
+  return 0;
+}
+
+// Tables of one vocabulary, its entry of phash_vocabs goes to initializers
+void write_vocab(FILE *out, FILE *initializers, int index,
+                 const compiled_vocab *v) {
+  fprintf(out, "static const char vocab_%d_strings[] =\n", index);
+  write_string_literal(out, v->pool.data, v->pool.len);
+  fprintf(out, ";\n\n");
+  write_table(out, index, "forward", &v->source_to_target);
+  write_table(out, index, "reverse", &v->target_to_source);
+
+  // The server matches it against the paths of the rooms file
+  fprintf(initializers, "    {\"");
+  for (const char *ch = v->path; *ch != '\0'; ch++) {
+    write_escaped_char(initializers, (unsigned char)*ch);
+  }
+  fprintf(initializers, "\", %lld, %lld,\n", (long long)v->st.st_size,
+          (long long)v->st.st_mtime);
+  write_table_initializer(initializers, index, "forward",
+                          &v->source_to_target);
+  fprintf(initializers, ",\n");
+  write_table_initializer(initializers, index, "reverse",
+                          &v->target_to_source);
+  fprintf(initializers, "},\n");
+}
+
+int write_source(const char *output, char **vocab_paths, int vocab_count) {
+  FILE *out = fopen(output, "w");
+  char *initializers_data = NULL;
+  size_t initializers_len = 0;
+  FILE *initializers = open_memstream(&initializers_data, &initializers_len);
+  if (out == NULL || initializers == NULL) {
+    perror("Error opening output file");
+    if (out != NULL) {
+      fclose(out);
+      remove(output);
+    }
+    if (initializers != NULL) {
+      fclose(initializers);
+      free(initializers_data);
+    }
+    return -1;
+  }
+
+  fprintf(out, "// Generated by vocab_compiler, do not edit\n\n");
+  fprintf(out, "#include \"../phash/phash.h\"\n\n");
+
+  for (int i = 0; i < vocab_count; i++) {
+    compiled_vocab v;
+    if (compile_vocab(vocab_paths[i], &v) < 0) {
+      fclose(initializers);
+      free(initializers_data);
+      fclose(out);
+      remove(output);
+      return -1;
+    }
+    write_vocab(out, initializers, i, &v);
+    compiled_vocab_free(&v);
+  }
+  fclose(initializers);
+
+  fprintf(out, "const phash_vocab phash_vocabs[] = {\n%s};\n\n",
+          initializers_data);
+  fprintf(out, "const int phash_vocab_count = %d;\n", vocab_count);
+  free(initializers_data);
+
+  if (fclose(out) != 0) {
+    perror("Error writing output file");
+    return -1;
+  }
+  return 0;
+}
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+// Binary dictionary
+//
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+// Sections in file order, every one aligned for its widest field
+static uint64_t align8(uint64_t offset) { return (offset + 7) & ~7ULL; }
+
+void layout_table(const compiled_table *t, uint64_t *offset,
+                  phash_file_table *out) {
+  out->count = t->count;
+  out->buckets = t->buckets;
+  out->displacements = *offset;
+  *offset = align8(*offset + (uint64_t)t->buckets * sizeof(uint32_t));
+  out->entries = *offset;
+  *offset = align8(*offset + (uint64_t)t->count * sizeof(phash_entry));
+  out->phrases = *offset;
+  out->phrase_count = t->phrase_count;
+  *offset = align8(*offset + (uint64_t)t->phrase_count * sizeof(uint32_t));
+}
+
+int write_padding(FILE *out, uint64_t from, uint64_t to) {
+  static const char zeros[8];
+  return fwrite(zeros, 1, to - from, out) == to - from ? 0 : -1;
+}
+
+int write_binary_table(FILE *out, const compiled_table *t,
+                       const phash_file_table *layout) {
+  size_t displacements_size = (size_t)t->buckets * sizeof(uint32_t);
+  size_t entries_size = (size_t)t->count * sizeof(phash_entry);
+  size_t phrases_size = (size_t)t->phrase_count * sizeof(uint32_t);
+
+  if (fwrite(t->displacements, 1, displacements_size, out) !=
+          displacements_size ||
+      write_padding(out, layout->displacements + displacements_size,
+                    layout->entries) < 0 ||
+      fwrite(t->entries, 1, entries_size, out) != entries_size ||
+      write_padding(out, layout->entries + entries_size, layout->phrases) <
+          0 ||
+      fwrite(t->phrases, 1, phrases_size, out) != phrases_size) {
+    return -1;
+  }
+  return write_padding(out, layout->phrases + phrases_size,
+                       align8(layout->phrases + phrases_size));
+}
+
+// One vocabulary as a file the server maps and reads in place: a header with
+// the offset of every section, then the strings and the tables of both
+// directions. It's written next to the output and renamed over it, a running
+// server keeps the old file mapped until it reloads.
+int write_binary(const char *output, const char *vocab_path) {
+  compiled_vocab v;
+  if (compile_vocab(vocab_path, &v) < 0) {
+    return -1;
+  }
+
+  phash_file_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, PHASH_FILE_MAGIC, sizeof(header.magic));
+  header.version = PHASH_FILE_VERSION;
+  header.byte_order = PHASH_FILE_BYTE_ORDER;
+
+  uint64_t offset = align8(sizeof(header));
+  header.strings = offset;
+  header.strings_size = v.pool.len;
+  offset = align8(offset + v.pool.len);
+  layout_table(&v.source_to_target, &offset, &header.source_to_target);
+  layout_table(&v.target_to_source, &offset, &header.target_to_source);
+  header.size = offset;
+
+  char temporary[4096];
+  snprintf(temporary, sizeof(temporary), "%s.tmp", output);
+  FILE *out = fopen(temporary, "wb");
+  if (out == NULL) {
+    perror("Error opening output file");
+    compiled_vocab_free(&v);
+    return -1;
+  }
+
+  int res = 0;
+  if (fwrite(&header, 1, sizeof(header), out) != sizeof(header) ||
+      write_padding(out, sizeof(header), header.strings) < 0 ||
+      fwrite(v.pool.data, 1, v.pool.len, out) != v.pool.len ||
+      write_padding(out, header.strings + v.pool.len,
+                    header.source_to_target.displacements) < 0 ||
+      write_binary_table(out, &v.source_to_target,
+                         &header.source_to_target) < 0 ||
+      write_binary_table(out, &v.target_to_source,
+                         &header.target_to_source) < 0) {
+    res = -1;
+  }
+
+  if (fclose(out) != 0 || res < 0 || rename(temporary, output) < 0) {
+    perror("Error writing output file");
+    remove(temporary);
+    res = -1;
+  } else {
+    printf("%s: %llu bytes\n", output, (unsigned long long)header.size);
+  }
+
+  compiled_vocab_free(&v);
+  return res;
+}
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+void print_usage(const char *program) {
+  printf("Usage: %s output.c vocabulary...\n", program);
+  printf("       %s -b output.dict vocabulary\n", program);
+  printf("  C source with the tables of every vocabulary, linked into the "
+         "server\n");
+  printf("  -b  one vocabulary as a binary dictionary, put its path in the "
+         "rooms file instead of the text one\n");
+}
+
+int main(int argc, char *argv[]) {
+  int binary = 0;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "bh")) != -1) {
+    switch (opt) {
+    case 'b':
+      binary = 1;
+      break;
+    default:
+      print_usage(argv[0]);
+      exit(opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+  }
+
+  int files = argc - optind;
+  if (files < 2 || (binary && files != 2)) {
+    print_usage(argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  int res = binary ? write_binary(argv[optind], argv[optind + 1])
+                   : write_source(argv[optind], &argv[optind + 1], files - 1);
+  return res < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,393 @@
+#include <errno.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "worker_pool.h"
+
+// Shared queue
+//
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+// Bounded MPMC queue: every slot carries a sequence number telling whether
+// it's free for the producer of that lap or full for its consumer, so
+// producers and consumers only race on their own index with a CAS.
+
+static int queue_push(worker_pool *p, worker_job *job) {
+  size_t pos = atomic_load_explicit(&p->head, memory_order_relaxed);
+
+  while (1) {
+    worker_slot *slot = &p->slots[pos & p->mask];
+    size_t sequence =
+        atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&p->head, &pos, pos + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        slot->job = job;
+        atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+        return 0;
+      }
+    } else if (diff < 0) {
+      return -1; // full
+    } else {
+      pos = atomic_load_explicit(&p->head, memory_order_relaxed);
+    }
+  }
+}
+
+static worker_job *queue_pop(worker_pool *p) {
+  size_t pos = atomic_load_explicit(&p->tail, memory_order_relaxed);
+
+  while (1) {
+    worker_slot *slot = &p->slots[pos & p->mask];
+    size_t sequence =
+        atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&p->tail, &pos, pos + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        worker_job *job = slot->job;
+        atomic_store_explicit(&slot->sequence, pos + p->mask + 1,
+                              memory_order_release);
+        return job;
+      }
+    } else if (diff < 0) {
+      return NULL; // empty
+    } else {
+      pos = atomic_load_explicit(&p->tail, memory_order_relaxed);
+    }
+  }
+}
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+// Deque of each worker
+//
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+// The worker running on this thread, NULL on any other thread
+static __thread worker *current_worker;
+
+static int deque_init(worker_deque *d, size_t size) {
+  d->jobs = malloc(size * sizeof(*d->jobs));
+  if (d->jobs == NULL) {
+    return -1;
+  }
+
+  for (size_t i = 0; i < size; i++) {
+    atomic_init(&d->jobs[i], NULL);
+  }
+  d->mask = (long)size - 1;
+  atomic_init(&d->top, 0);
+  atomic_init(&d->bottom, 0);
+  return 0;
+}
+
+// Owner only
+static int deque_push(worker_deque *d, worker_job *job) {
+  long bottom = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+  long top = atomic_load_explicit(&d->top, memory_order_acquire);
+  if (bottom - top > d->mask) {
+    return -1; // full
+  }
+
+  atomic_store_explicit(&d->jobs[bottom & d->mask], job, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  atomic_store_explicit(&d->bottom, bottom + 1, memory_order_relaxed);
+  return 0;
+}
+
+// Owner only, newest job first
+static worker_job *deque_take(worker_deque *d) {
+  long bottom = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+  atomic_store_explicit(&d->bottom, bottom, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  long top = atomic_load_explicit(&d->top, memory_order_relaxed);
+
+  if (top > bottom) {
+    // Empty
+    atomic_store_explicit(&d->bottom, bottom + 1, memory_order_relaxed);
+    return NULL;
+  }
+
+  worker_job *job =
+      atomic_load_explicit(&d->jobs[bottom & d->mask], memory_order_relaxed);
+  if (top == bottom) {
+    // Last job, a thief may be taking it right now
+    if (!atomic_compare_exchange_strong_explicit(&d->top, &top, top + 1,
+                                                 memory_order_seq_cst,
+                                                 memory_order_relaxed)) {
+      job = NULL;
+    }
+    atomic_store_explicit(&d->bottom, bottom + 1, memory_order_relaxed);
+  }
+  return job;
+}
+
+// Any thread, oldest job first. NULL when empty or when another thief won.
+static worker_job *deque_steal(worker_deque *d) {
+  long top = atomic_load_explicit(&d->top, memory_order_acquire);
+  atomic_thread_fence(memory_order_seq_cst);
+  long bottom = atomic_load_explicit(&d->bottom, memory_order_acquire);
+
+  if (top >= bottom) {
+    return NULL;
+  }
+
+  worker_job *job =
+      atomic_load_explicit(&d->jobs[top & d->mask], memory_order_relaxed);
+  if (!atomic_compare_exchange_strong_explicit(&d->top, &top, top + 1,
+                                               memory_order_seq_cst,
+                                               memory_order_relaxed)) {
+    return NULL;
+  }
+  return job;
+}
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+// Overflow list
+//
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+// Lock-free stack of the jobs that found the shared queue full. Workers take
+// the whole list with one exchange, never a single node, so there is no ABA.
+
+static void overflow_push(worker_pool *p, worker_job *job) {
+  worker_job *head = atomic_load_explicit(&p->overflow, memory_order_relaxed);
+  do {
+    job->next = head;
+  } while (!atomic_compare_exchange_weak_explicit(&p->overflow, &head, job,
+                                                  memory_order_release,
+                                                  memory_order_relaxed));
+}
+
+// The oldest job is returned, the others go on the worker's deque, or back on
+// the list when it's full
+static worker_job *overflow_take(worker *w) {
+  worker_pool *p = w->pool;
+  if (atomic_load_explicit(&p->overflow, memory_order_relaxed) == NULL) {
+    return NULL;
+  }
+
+  worker_job *job =
+      atomic_exchange_explicit(&p->overflow, NULL, memory_order_acquire);
+  worker_job *oldest = NULL;
+  while (job != NULL) {
+    worker_job *next = job->next;
+    job->next = oldest;
+    oldest = job;
+    job = next;
+  }
+  if (oldest == NULL) {
+    return NULL;
+  }
+
+  job = oldest->next;
+  while (job != NULL) {
+    worker_job *next = job->next;
+    if (deque_push(&w->deque, job) < 0) {
+      overflow_push(p, job);
+    }
+    job = next;
+  }
+  return oldest;
+}
+// +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+// Own deque first, then the shared queue and the overflow list, then the
+// other workers starting from the next one, so thieves don't all pick the
+// same victim
+static worker_job *worker_find_job(worker *w) {
+  worker_pool *p = w->pool;
+
+  worker_job *job = deque_take(&w->deque);
+  if (job != NULL) {
+    return job;
+  }
+
+  job = queue_pop(p);
+  if (job != NULL) {
+    return job;
+  }
+
+  job = overflow_take(w);
+  if (job != NULL) {
+    return job;
+  }
+
+  for (int i = 1; i < p->worker_count; i++) {
+    worker *victim = &p->workers[(w->id + i) % p->worker_count];
+    job = deque_steal(&victim->deque);
+    if (job != NULL) {
+      atomic_fetch_add_explicit(&p->steals, 1, memory_order_relaxed);
+      return job;
+    }
+  }
+  return NULL;
+}
+
+// The semaphore counts jobs not taken yet, wherever they were pushed: a
+// worker that gets past sem_wait owns one of them and looks until it finds it
+static void *worker_thread(void *arg) {
+  worker *w = (worker *)arg;
+  worker_pool *p = w->pool;
+  current_worker = w;
+
+  while (1) {
+    while (sem_wait(&p->ready) < 0 && errno == EINTR) {
+    }
+
+    if (atomic_load(&p->stopping)) {
+      return NULL;
+    }
+
+    // Posted after the push, but the job may be in a slot another producer
+    // is still filling, or a thief may be holding it for a moment
+    worker_job *job;
+    while ((job = worker_find_job(w)) == NULL) {
+      sched_yield();
+    }
+
+    job->run(job);
+    atomic_fetch_add_explicit(&p->completed, 1, memory_order_relaxed);
+  }
+}
+
+// Stop and join the first count workers, free every deque up to created
+static void worker_pool_stop(worker_pool *p, int count, int created) {
+  atomic_store(&p->stopping, 1);
+  for (int i = 0; i < count; i++) {
+    sem_post(&p->ready);
+  }
+  for (int i = 0; i < count; i++) {
+    pthread_join(p->workers[i].thread, NULL);
+  }
+  for (int i = 0; i < created; i++) {
+    free(p->workers[i].deque.jobs);
+  }
+}
+
+// queue_size is rounded up to a power of 2, it's the size of the shared queue
+// and of every deque. Fails unless every one of the workers starts, and there
+// must be at least one: jobs never run on the submitting thread.
+int worker_pool_init(worker_pool *p, int workers, size_t queue_size) {
+  if (workers < 1) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  size_t size = 2;
+  while (size < queue_size) {
+    size *= 2;
+  }
+
+  p->slots = malloc(size * sizeof(worker_slot));
+  p->workers = calloc(workers, sizeof(worker));
+  if (p->slots == NULL || p->workers == NULL) {
+    free(p->slots);
+    free(p->workers);
+    return -1;
+  }
+
+  for (size_t i = 0; i < size; i++) {
+    atomic_init(&p->slots[i].sequence, i);
+    p->slots[i].job = NULL;
+  }
+  p->mask = size - 1;
+  atomic_init(&p->head, 0);
+  atomic_init(&p->tail, 0);
+  atomic_init(&p->overflow, NULL);
+  atomic_init(&p->stopping, 0);
+  atomic_init(&p->submitted, 0);
+  atomic_init(&p->completed, 0);
+  atomic_init(&p->overflows, 0);
+  atomic_init(&p->local_runs, 0);
+  atomic_init(&p->steals, 0);
+  atomic_init(&p->max_depth, 0);
+  if (sem_init(&p->ready, 0, 0) < 0) {
+    free(p->workers);
+    free(p->slots);
+    return -1;
+  }
+
+  // Every deque exists before the first thread can steal from it
+  int created = 0;
+  while (created < workers &&
+         deque_init(&p->workers[created].deque, size) == 0) {
+    p->workers[created].pool = p;
+    p->workers[created].id = created;
+    created++;
+  }
+
+  p->worker_count = 0;
+  if (created == workers) {
+    for (int i = 0; i < workers; i++) {
+      int err = pthread_create(&p->workers[i].thread, NULL, worker_thread,
+                               &p->workers[i]);
+      if (err != 0) {
+        errno = err;
+        break;
+      }
+      p->worker_count++;
+    }
+  }
+
+  if (p->worker_count < workers) {
+    int err = errno;
+    worker_pool_stop(p, p->worker_count, created);
+    sem_destroy(&p->ready);
+    free(p->workers);
+    free(p->slots);
+    errno = err;
+    return -1;
+  }
+  return 0;
+}
+
+void worker_pool_destroy(worker_pool *p) {
+  worker_pool_stop(p, p->worker_count, p->worker_count);
+  sem_destroy(&p->ready);
+  free(p->workers);
+  free(p->slots);
+}
+
+// Never blocks and never runs the job: a job submitted by a job goes on its
+// worker's deque, anything else on the shared queue, and when that is full on
+// the overflow list
+int worker_pool_submit(worker_pool *p, worker_job *job) {
+  atomic_fetch_add_explicit(&p->submitted, 1, memory_order_relaxed);
+
+  int parked = 0;
+  worker *w = current_worker;
+  if (w != NULL && w->pool == p && deque_push(&w->deque, job) == 0) {
+    atomic_fetch_add_explicit(&p->local_runs, 1, memory_order_relaxed);
+  } else if (queue_push(p, job) < 0) {
+    atomic_fetch_add_explicit(&p->overflows, 1, memory_order_relaxed);
+    overflow_push(p, job);
+    parked = 1;
+  }
+
+  unsigned long depth = worker_pool_depth(p);
+  unsigned long max = atomic_load_explicit(&p->max_depth, memory_order_relaxed);
+  while (depth > max && !atomic_compare_exchange_weak_explicit(
+                            &p->max_depth, &max, depth, memory_order_relaxed,
+                            memory_order_relaxed)) {
+  }
+
+  sem_post(&p->ready);
+  return parked;
+}
+
+// Jobs submitted and not finished yet, queued or running
+unsigned long worker_pool_depth(worker_pool *p) {
+  unsigned long completed =
+      atomic_load_explicit(&p->completed, memory_order_relaxed);
+  unsigned long submitted =
+      atomic_load_explicit(&p->submitted, memory_order_relaxed);
+  return submitted > completed ? submitted - completed : 0;
+}
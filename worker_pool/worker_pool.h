@@ -0,0 +1,83 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+// Fixed set of threads running jobs off the reactors, scheduled by work
+// stealing. Every worker has its own deque: jobs submitted by a running job
+// go to the bottom of its worker's deque and are taken back LIFO, while cache
+// hot. Jobs submitted by any other thread go through a shared bounded
+// lock-free queue. An idle worker takes from its deque, then from the shared
+// queue, then steals the oldest job of another worker, so a burst on one
+// worker is spread over all of them. A job hands its result back itself (the
+// server posts it to the reactor that owns the connection).
+//
+// A job never runs on the thread submitting it: when the deque and the shared
+// queue are full it's parked on an overflow list the workers drain, and
+// submit tells the caller to slow down (the server stops reading the client).
+
+typedef struct worker_job worker_job;
+typedef void (*worker_job_callback)(worker_job *job);
+
+// Embed as the first member of the struct carrying the work
+struct worker_job {
+  worker_job_callback run;
+  worker_job *next; // on the overflow list
+};
+
+typedef struct {
+  atomic_size_t sequence;
+  worker_job *job;
+} worker_slot;
+
+typedef struct worker_pool worker_pool;
+
+// Chase-Lev deque: the owner pushes and takes at the bottom without a CAS,
+// thieves race for the top
+typedef struct {
+  atomic_long top;
+  atomic_long bottom;
+  _Atomic(worker_job *) *jobs;
+  long mask;
+} worker_deque;
+
+typedef struct {
+  worker_pool *pool;
+  int id;
+  pthread_t thread;
+  worker_deque deque;
+} worker;
+
+struct worker_pool {
+  worker_slot *slots;
+  size_t mask;
+  atomic_size_t head; // next slot to fill
+  atomic_size_t tail; // next slot to run
+
+  _Atomic(worker_job *) overflow; // newest first
+
+  sem_t ready;
+  atomic_int stopping;
+  worker *workers;
+  int worker_count;
+
+  atomic_ulong submitted;
+  atomic_ulong completed;
+  atomic_ulong overflows;   // queue full, parked on the overflow list
+  atomic_ulong local_runs;  // submitted by a job and pushed on its deque
+  atomic_ulong steals;      // taken from the deque of another worker
+  atomic_ulong max_depth;
+};
+
+int worker_pool_init(worker_pool *p, int workers, size_t queue_size);
+void worker_pool_destroy(worker_pool *p);
+
+// 0 when queued, 1 when parked because the pool is saturated
+int worker_pool_submit(worker_pool *p, worker_job *job);
+
+unsigned long worker_pool_depth(worker_pool *p);
+
+#endif // WORKERPOOL_H